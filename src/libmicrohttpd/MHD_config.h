@@ -65,6 +65,8 @@
 #define HAVE_SYS_TYPES_H 1 /* Define to 1 if you have the <sys/types.h> header file. */
 #define HAVE_TIME_H 1 /* Define to 1 if you have the <time.h> header file. */
 #define HTTPS_SUPPORT 0 /* disable HTTPS support */
+#define MHD_POOL_CACHE_SIZE 32 /* number of released connection memory pools kept for reuse by every thread, 0 to disable */
+// #define MHD_POOL_CACHE_MADV_FREE 1 /* let the system lazily reclaim memory of cached pools using madvise(MADV_FREE) */
 
 // 5) Package information
 
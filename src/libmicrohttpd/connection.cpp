@@ -617,15 +617,30 @@ try_grow_read_buffer (struct MHD_Connection *connection)
 {
   void *buf;
   size_t new_size;
+  struct MHD_Daemon *daemon = connection->daemon;
 
   if (0 == connection->read_buffer_size)
-    new_size = connection->daemon->pool_size / 2;
+    new_size = (0 != daemon->pool_initial) && (daemon->pool_initial < daemon->pool_size / 2)
+      ? daemon->pool_initial
+      : daemon->pool_size / 2;
+  else if (0 != daemon->pool_initial)
+    new_size = 2 * connection->read_buffer_size; /* started small, grow quickly */
   else
-    new_size = connection->read_buffer_size + MHD_BUF_INC_SIZE;
+    new_size = connection->read_buffer_size + daemon->pool_increment;
   buf = MHD_pool_reallocate (connection->pool,
                              connection->read_buffer,
                              connection->read_buffer_size,
                              new_size);
+  if ( (NULL == buf) &&
+       (new_size > connection->read_buffer_size + daemon->pool_increment) )
+    {
+      /* doubling does not fit, try growing by the increment only */
+      new_size = connection->read_buffer_size + daemon->pool_increment;
+      buf = MHD_pool_reallocate (connection->pool,
+                                 connection->read_buffer,
+                                 connection->read_buffer_size,
+                                 new_size);
+    }
   if (NULL == buf)
     return MHD_NO;
   /* we can actually grow the buffer, do it! */
@@ -1706,6 +1721,7 @@ do_read (struct MHD_Connection *connection)
       return MHD_YES;
     }
   connection->read_buffer_offset += bytes_read;
+  connection->request_bytes_received += bytes_read;
   return MHD_YES;
 }
 
@@ -1759,6 +1775,7 @@ do_write (struct MHD_Connection *connection)
      buffer involvement! */
   if (0 != max)
     connection->write_buffer_send_offset += ret;
+  connection->request_bytes_sent += ret;
   return MHD_YES;
 }
 
@@ -2027,6 +2044,8 @@ update_last_activity (struct MHD_Connection *connection)
 int
 MHD_connection_handle_read (struct MHD_Connection *connection)
 {
+  uint64_t ready;
+
   update_last_activity (connection);
   if (MHD_CONNECTION_CLOSED == connection->state)
     return MHD_YES;
@@ -2035,8 +2054,17 @@ MHD_connection_handle_read (struct MHD_Connection *connection)
   if (connection->read_buffer_offset + connection->daemon->pool_increment >
       connection->read_buffer_size)
     try_grow_read_buffer (connection);
+  /* remember when the data (of a new request) were found ready */
+  ready =
+    ( (0 == (connection->daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+      (0 != connection->daemon->events_received) )
+    ? connection->daemon->events_received : MHD_monotonic_ns ();
+  if ( (MHD_CONNECTION_INIT == connection->state) &&
+       (0 == connection->read_buffer_offset) )
+    connection->request_received = ready;
   if (MHD_NO == do_read (connection))
     return MHD_YES;
+  connection->data_received = ready;
   while (1)
     {
 #if DEBUG_STATES
@@ -2137,6 +2165,7 @@ MHD_connection_handle_write (struct MHD_Connection *connection)
                    &HTTP_100_CONTINUE[connection->continue_message_write_offset]);
 #endif
           connection->continue_message_write_offset += ret;
+          connection->request_bytes_sent += ret;
           break;
         case MHD_CONNECTION_CONTINUE_SENT:
         case MHD_CONNECTION_BODY_RECEIVED:
@@ -2191,6 +2220,7 @@ MHD_connection_handle_write (struct MHD_Connection *connection)
               return MHD_YES;
             }
           connection->response_write_position += ret;
+          connection->request_bytes_sent += ret;
           if (connection->response_write_position ==
               connection->response->total_size)
             connection->state = MHD_CONNECTION_FOOTERS_SENT; /* have no footers */
@@ -2283,6 +2313,11 @@ cleanup_connection (struct MHD_Connection *connection)
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_unlock_(&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to release cleanup mutex\n");
+  if (NULL != daemon->notify_connection)
+    daemon->notify_connection (daemon->notify_connection_cls,
+                               connection,
+                               &connection->socket_context,
+                               MHD_CONNECTION_NOTIFY_CLOSED);
 }
 
 
@@ -2640,6 +2675,9 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
               /* can try to keep-alive */
               connection->version = NULL;
               connection->state = MHD_CONNECTION_INIT;
+              /* a pipelined request might have been received already */
+              connection->request_received = MHD_monotonic_ns ();
+              connection->data_received = connection->request_received;
               connection->read_buffer
                 = (char*) MHD_pool_reset (connection->pool,
                                   connection->read_buffer,
@@ -2649,6 +2687,8 @@ MHD_connection_handle_idle (struct MHD_Connection *connection)
           connection->client_context = NULL;
           connection->continue_message_write_offset = 0;
           connection->responseCode = 0;
+          connection->request_bytes_received = 0;
+          connection->request_bytes_sent = 0;
           connection->headers_received = NULL;
 	  connection->headers_received_tail = NULL;
           connection->response_write_position = 0;
@@ -2839,6 +2879,21 @@ MHD_get_connection_info (struct MHD_Connection *connection,
       return (const union MHD_ConnectionInfo *) &connection->daemon;
     case MHD_CONNECTION_INFO_CONNECTION_FD:
       return (const union MHD_ConnectionInfo *) &connection->socket_fd;
+    case MHD_CONNECTION_INFO_REQUEST_RECEIVED:
+      return (const union MHD_ConnectionInfo *) &connection->request_received;
+    case MHD_CONNECTION_INFO_SOCKET_CONTEXT:
+      return (const union MHD_ConnectionInfo *) &connection->socket_context;
+    case MHD_CONNECTION_INFO_RESPONSE_CODE:
+      connection->response_code = connection->responseCode & (~MHD_ICY_FLAG);
+      return (const union MHD_ConnectionInfo *) &connection->response_code;
+    case MHD_CONNECTION_INFO_BYTES_RECEIVED:
+      return (const union MHD_ConnectionInfo *) &connection->request_bytes_received;
+    case MHD_CONNECTION_INFO_BYTES_SENT:
+      return (const union MHD_ConnectionInfo *) &connection->request_bytes_sent;
+    case MHD_CONNECTION_INFO_CONNECTION_ACCEPTED:
+      return (const union MHD_ConnectionInfo *) &connection->connection_accepted;
+    case MHD_CONNECTION_INFO_DATA_RECEIVED:
+      return (const union MHD_ConnectionInfo *) &connection->data_received;
     default:
       return NULL;
     };
@@ -2856,7 +2911,7 @@ MHD_get_connection_info (struct MHD_Connection *connection,
  */
 int
 MHD_set_connection_option (struct MHD_Connection *connection,
-			   int /*enum MHD_CONNECTION_OPTION*/ option,
+			   enum MHD_CONNECTION_OPTION option,
 			   ...)
 {
   va_list ap;
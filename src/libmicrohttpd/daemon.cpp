@@ -44,12 +44,6 @@
 #include <limits.h>
 #include "autoinit_funcs.h"
 
-#if HAVE_SEARCH_H
-#include <search.h>
-#else
-#include "tsearch.h"
-#endif
-
 #if HTTPS_SUPPORT
 #include "connection_https.h"
 #include <gcrypt.h>
@@ -215,18 +209,122 @@ struct MHD_IPCount
    * Counter.
    */
   unsigned int count;
+
+  /**
+   * Next entry in the same hash bucket.
+   */
+  struct MHD_IPCount *next;
+};
+
+
+/**
+ * Number of independently locked shards of the per-IP connection
+ * counts, must be a power of two.
+ */
+#define MHD_IP_COUNT_SHARDS 16
+
+
+/**
+ * One shard of the hash table storing the per-IP connection counts.
+ */
+struct MHD_IPCountShard
+{
+  /**
+   * Mutex protecting this shard.
+   */
+  MHD_mutex_ mutex;
+
+  /**
+   * Hash buckets, NULL until the first address is added.
+   */
+  struct MHD_IPCount **buckets;
+
+  /**
+   * Number of buckets, zero or a power of two.
+   */
+  unsigned int buckets_size;
+
+  /**
+   * Number of addresses in this shard.
+   */
+  unsigned int size;
 };
 
 
 /**
- * Lock shared structure for IP connection counts and connection DLLs.
+ * Create the per-IP connection counts table, if a per-IP connection
+ * limit is used.
  *
- * @param daemon handle to daemon where lock is
+ * @param daemon handle to the master daemon
+ * @return #MHD_YES on success and #MHD_NO otherwise
+ */
+static int
+MHD_ip_count_init (struct MHD_Daemon *daemon)
+{
+  unsigned int i;
+
+  daemon->per_ip_connection_count = NULL;
+  if (0 == daemon->per_ip_connection_limit)
+    return MHD_YES;
+
+  daemon->per_ip_connection_count = (struct MHD_IPCountShard*) calloc (MHD_IP_COUNT_SHARDS, sizeof (struct MHD_IPCountShard));
+  if (NULL == daemon->per_ip_connection_count)
+    return MHD_NO;
+  for (i = 0; i < MHD_IP_COUNT_SHARDS; i++)
+    if (MHD_YES != MHD_mutex_create_ (&daemon->per_ip_connection_count[i].mutex))
+      {
+        while (i--)
+          (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_count[i].mutex);
+        free (daemon->per_ip_connection_count);
+        daemon->per_ip_connection_count = NULL;
+        return MHD_NO;
+      }
+  return MHD_YES;
+}
+
+
+/**
+ * Destroy the per-IP connection counts table.
+ *
+ * @param daemon handle to the master daemon
  */
 static void
-MHD_ip_count_lock (struct MHD_Daemon *daemon)
+MHD_ip_count_destroy (struct MHD_Daemon *daemon)
 {
-  if (MHD_YES != MHD_mutex_lock_(&daemon->per_ip_connection_mutex))
+  struct MHD_IPCountShard *shard;
+  struct MHD_IPCount *entry;
+  unsigned int i;
+  unsigned int j;
+
+  if (NULL == daemon->per_ip_connection_count)
+    return;
+
+  for (i = 0; i < MHD_IP_COUNT_SHARDS; i++)
+    {
+      shard = &daemon->per_ip_connection_count[i];
+      for (j = 0; j < shard->buckets_size; j++)
+        while (NULL != (entry = shard->buckets[j]))
+          {
+            shard->buckets[j] = entry->next;
+            free (entry);
+          }
+      free (shard->buckets);
+      (void) MHD_mutex_destroy_ (&shard->mutex);
+    }
+  free (daemon->per_ip_connection_count);
+  daemon->per_ip_connection_count = NULL;
+}
+
+
+/**
+ * Lock shard of the IP connection counts.
+ *
+ * @param shard shard to lock
+ */
+static void
+MHD_ip_count_lock (struct MHD_IPCountShard *shard)
+{
+  if (MHD_YES != MHD_mutex_lock_(&shard->mutex))
     {
       MHD_PANIC ("Failed to acquire IP connection limit mutex\n");
     }
@@ -234,14 +332,14 @@ MHD_ip_count_lock (struct MHD_Daemon *daemon)
 
 
 /**
- * Unlock shared structure for IP connection counts and connection DLLs.
+ * Unlock shard of the IP connection counts.
  *
- * @param daemon handle to daemon where lock is
+ * @param shard shard to unlock
  */
 static void
-MHD_ip_count_unlock (struct MHD_Daemon *daemon)
+MHD_ip_count_unlock (struct MHD_IPCountShard *shard)
 {
-  if (MHD_YES != MHD_mutex_unlock_(&daemon->per_ip_connection_mutex))
+  if (MHD_YES != MHD_mutex_unlock_(&shard->mutex))
     {
       MHD_PANIC ("Failed to release IP connection limit mutex\n");
     }
@@ -249,9 +347,28 @@ MHD_ip_count_unlock (struct MHD_Daemon *daemon)
 
 
 /**
- * Tree comparison function for IP addresses (supplied to tsearch() family).
- * We compare everything in the struct up through the beginning of the
- * 'count' field.
+ * Hash function for IP addresses (FNV-1a). We hash everything in the
+ * struct up through the beginning of the 'count' field.
+ *
+ * @param key address to hash
+ * @return hash of the address
+ */
+static unsigned int
+MHD_ip_addr_hash (const struct MHD_IPCount *key)
+{
+  const unsigned char *data = (const unsigned char *) key;
+  unsigned int hash = 2166136261u;
+  size_t i;
+
+  for (i = 0; i < offsetof (struct MHD_IPCount, count); i++)
+    hash = (hash ^ data[i]) * 16777619u;
+  return hash ^ (hash >> 16);
+}
+
+
+/**
+ * Comparison function for IP addresses. We compare everything in the
+ * struct up through the beginning of the 'count' field.
  *
  * @param a1 first address to compare
  * @param a2 second address to compare
@@ -264,6 +381,67 @@ MHD_ip_addr_compare (const void *a1, const void *a2)
 }
 
 
+/**
+ * Find the bucket of the given address in a shard. The shard must have
+ * buckets allocated.
+ *
+ * @param shard shard containing the address
+ * @param key address to find
+ * @param hash hash of the address
+ * @return pointer to the link pointing to the address entry,
+ *   or to the NULL link at the end of its bucket
+ */
+static struct MHD_IPCount **
+MHD_ip_count_find (struct MHD_IPCountShard *shard,
+                   const struct MHD_IPCount *key,
+                   unsigned int hash)
+{
+  struct MHD_IPCount **link;
+
+  link = &shard->buckets[(hash / MHD_IP_COUNT_SHARDS) & (shard->buckets_size - 1)];
+  while ( (NULL != *link) &&
+          (0 != MHD_ip_addr_compare (*link, key)) )
+    link = &(*link)->next;
+  return link;
+}
+
+
+/**
+ * Double the number of buckets of a shard. Failure to allocate
+ * the buckets is not an error if the shard already has some.
+ *
+ * @param shard shard to grow
+ * @return #MHD_YES if the shard has buckets allocated
+ */
+static int
+MHD_ip_count_grow (struct MHD_IPCountShard *shard)
+{
+  struct MHD_IPCount **buckets;
+  struct MHD_IPCount *entry;
+  unsigned int buckets_size;
+  unsigned int bucket;
+  unsigned int i;
+
+  buckets_size = shard->buckets_size ? 2 * shard->buckets_size : 16;
+  buckets = (struct MHD_IPCount **) calloc (buckets_size, sizeof (struct MHD_IPCount *));
+  if (NULL == buckets)
+    return 0 != shard->buckets_size ? MHD_YES : MHD_NO;
+
+  for (i = 0; i < shard->buckets_size; i++)
+    while (NULL != (entry = shard->buckets[i]))
+      {
+        shard->buckets[i] = entry->next;
+        bucket = (MHD_ip_addr_hash (entry) / MHD_IP_COUNT_SHARDS) & (buckets_size - 1);
+        entry->next = buckets[bucket];
+        buckets[bucket] = entry;
+      }
+  free (shard->buckets);
+  shard->buckets = buckets;
+  shard->buckets_size = buckets_size;
+  return MHD_YES;
+}
+
+
 /**
  * Parse address and initialize 'key' using the address.
  *
@@ -318,9 +496,11 @@ MHD_ip_limit_add (struct MHD_Daemon *daemon,
 		  const struct sockaddr *addr,
 		  socklen_t addrlen)
 {
+  struct MHD_IPCountShard *shard;
+  struct MHD_IPCount search_key;
+  struct MHD_IPCount **link;
   struct MHD_IPCount *key;
-  void **nodep;
-  void *node;
+  unsigned int hash;
   int result;
 
   daemon = MHD_get_master (daemon);
@@ -328,43 +508,52 @@ MHD_ip_limit_add (struct MHD_Daemon *daemon,
   if (0 == daemon->per_ip_connection_limit)
     return MHD_YES;
 
-  if (NULL == (key = (struct MHD_IPCount*) malloc (sizeof(*key))))
-    return MHD_NO;
-
   /* Initialize key */
-  if (MHD_NO == MHD_ip_addr_to_key (addr, addrlen, key))
+  if (MHD_NO == MHD_ip_addr_to_key (addr, addrlen, &search_key))
     {
       /* Allow unhandled address types through */
-      free (key);
       return MHD_YES;
     }
-  MHD_ip_count_lock (daemon);
+  hash = MHD_ip_addr_hash (&search_key);
+  shard = &daemon->per_ip_connection_count[hash & (MHD_IP_COUNT_SHARDS - 1)];
+  MHD_ip_count_lock (shard);
 
-  /* Search for the IP address */
-  if (NULL == (nodep = (void**) tsearch (key,
-				&daemon->per_ip_connection_count,
-				&MHD_ip_addr_compare)))
+  /* Keep at most one address per bucket on average */
+  if ( (shard->size >= shard->buckets_size) &&
+       (MHD_YES != MHD_ip_count_grow (shard)) )
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
 		"Failed to add IP connection count node\n");
 #endif
-      MHD_ip_count_unlock (daemon);
-      free (key);
+      MHD_ip_count_unlock (shard);
       return MHD_NO;
     }
-  node = *nodep;
-  /* If we got an existing node back, free the one we created */
-  if (node != key)
-    free(key);
-  key = (struct MHD_IPCount *) node;
+
+  /* Search for the IP address */
+  link = MHD_ip_count_find (shard, &search_key, hash);
+  if (NULL == (key = *link))
+    {
+      if (NULL == (key = (struct MHD_IPCount*) malloc (sizeof(*key))))
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (daemon,
+                    "Failed to add IP connection count node\n");
+#endif
+          MHD_ip_count_unlock (shard);
+          return MHD_NO;
+        }
+      memcpy (key, &search_key, sizeof (*key));
+      *link = key;
+      shard->size++;
+    }
   /* Test if there is room for another connection; if so,
    * increment count */
   result = (key->count < daemon->per_ip_connection_limit);
   if (MHD_YES == result)
     ++key->count;
 
-  MHD_ip_count_unlock (daemon);
+  MHD_ip_count_unlock (shard);
   return result;
 }
 
@@ -382,9 +571,11 @@ MHD_ip_limit_del (struct MHD_Daemon *daemon,
 		  const struct sockaddr *addr,
 		  socklen_t addrlen)
 {
+  struct MHD_IPCountShard *shard;
   struct MHD_IPCount search_key;
   struct MHD_IPCount *found_key;
-  void **nodep;
+  struct MHD_IPCount **link;
+  unsigned int hash;
 
   daemon = MHD_get_master (daemon);
   /* Ignore if no connection limit assigned */
@@ -393,19 +584,19 @@ MHD_ip_limit_del (struct MHD_Daemon *daemon,
   /* Initialize search key */
   if (MHD_NO == MHD_ip_addr_to_key (addr, addrlen, &search_key))
     return;
+  hash = MHD_ip_addr_hash (&search_key);
+  shard = &daemon->per_ip_connection_count[hash & (MHD_IP_COUNT_SHARDS - 1)];
 
-  MHD_ip_count_lock (daemon);
+  MHD_ip_count_lock (shard);
 
   /* Search for the IP address */
-  if (NULL == (nodep = (void**) tfind (&search_key,
-			      &daemon->per_ip_connection_count,
-			      &MHD_ip_addr_compare)))
+  if ( (0 == shard->buckets_size) ||
+       (NULL == (found_key = *(link = MHD_ip_count_find (shard, &search_key, hash)))) )
     {
       /* Something's wrong if we couldn't find an IP address
        * that was previously added */
       MHD_PANIC ("Failed to find previously-added IP address\n");
     }
-  found_key = (struct MHD_IPCount *) *nodep;
   /* Validate existing count for IP address */
   if (0 == found_key->count)
     {
@@ -414,13 +605,12 @@ MHD_ip_limit_del (struct MHD_Daemon *daemon,
   /* Remove the node entirely if count reduces to 0 */
   if (0 == --found_key->count)
     {
-      tdelete (found_key,
-	       &daemon->per_ip_connection_count,
-	       &MHD_ip_addr_compare);
+      *link = found_key->next;
+      shard->size--;
       free (found_key);
     }
 
-  MHD_ip_count_unlock (daemon);
+  MHD_ip_count_unlock (shard);
 }
 
 
@@ -781,10 +971,11 @@ MHD_handle_connection (void *data)
   struct pollfd p[1];
 #endif
 
-  timeout = con->daemon->connection_timeout;
   while ( (MHD_YES != con->daemon->shutdown) &&
 	  (MHD_CONNECTION_CLOSED != con->state) )
     {
+      /* the timeout may be changed by MHD_set_connection_option */
+      timeout = con->connection_timeout;
       tvp = NULL;
       if (timeout > 0)
 	{
@@ -1087,6 +1278,7 @@ typedef MHD_THRD_RTRN_TYPE_ (MHD_THRD_CALL_SPEC_ *ThreadStartRoutine)(void *cls)
  *
  * @param thread handle to initialize
  * @param daemon daemon with options
+ * @param affinity CPUs the thread may run on, NULL for any
  * @param start_routine main function of thread
  * @param arg argument for start_routine
  * @return 0 on success
@@ -1094,6 +1286,7 @@ typedef MHD_THRD_RTRN_TYPE_ (MHD_THRD_CALL_SPEC_ *ThreadStartRoutine)(void *cls)
 static int
 create_thread (MHD_thread_handle_ *thread,
 	       const struct MHD_Daemon *daemon,
+	       const struct MHD_ThreadAffinity *affinity,
 	       ThreadStartRoutine start_routine,
 	       void *arg)
 {
@@ -1101,16 +1294,45 @@ create_thread (MHD_thread_handle_ *thread,
   pthread_attr_t attr;
   pthread_attr_t *pattr;
   int ret;
+#ifdef __linux__
+  cpu_set_t allowed;
+  cpu_set_t cpus;
+  unsigned int i;
+#endif
 
-  if (0 != daemon->thread_stack_size)
+  if ( (0 != daemon->thread_stack_size) || (NULL != affinity) )
     {
       if (0 != (ret = pthread_attr_init (&attr)))
 	goto ERR;
-      if (0 != (ret = pthread_attr_setstacksize (&attr, daemon->thread_stack_size)))
+      if ( (0 != daemon->thread_stack_size) &&
+           (0 != (ret = pthread_attr_setstacksize (&attr, daemon->thread_stack_size))) )
 	{
 	  pthread_attr_destroy (&attr);
 	  goto ERR;
 	}
+#ifdef __linux__
+      if (NULL != affinity)
+        {
+          /* only use CPUs available to the process, otherwise
+             the thread could not be created */
+          if (0 != sched_getaffinity (0, sizeof (allowed), &allowed))
+            memset (&allowed, 0xff, sizeof (allowed));
+          CPU_ZERO (&cpus);
+          for (i = 0; i < affinity->cpus_size; i++)
+            if ( (affinity->cpus[i] < CPU_SETSIZE) &&
+                 CPU_ISSET (affinity->cpus[i], &allowed) )
+              CPU_SET (affinity->cpus[i], &cpus);
+          /* an empty set or a failure only leaves the thread unpinned */
+          if ( (0 != CPU_COUNT (&cpus)) &&
+               (0 != pthread_attr_setaffinity_np (&attr, sizeof (cpus), &cpus)) )
+            {
+#if HAVE_MESSAGES
+              MHD_DLOG (daemon,
+                        "Failed to set thread affinity\n");
+#endif
+            }
+        }
+#endif
       pattr = &attr;
     }
   else
@@ -1122,7 +1344,7 @@ create_thread (MHD_thread_handle_ *thread,
 #ifdef HAVE_PTHREAD_SETNAME_NP
   (void) pthread_setname_np (*thread, "libmicrohttpd");
 #endif /* HAVE_PTHREAD_SETNAME_NP */
-  if (0 != daemon->thread_stack_size)
+  if (NULL != pattr)
     pthread_attr_destroy (&attr);
   return ret;
  ERR:
@@ -1133,6 +1355,7 @@ create_thread (MHD_thread_handle_ *thread,
   errno = EINVAL;
   return ret;
 #elif defined(MHD_USE_W32_THREADS)
+  (void) affinity;
   *thread = CreateThread(NULL, daemon->thread_stack_size, start_routine,
                           arg, 0, NULL);
   return (NULL != (*thread)) ? 0 : 1;
@@ -1333,6 +1556,7 @@ internal_add_connection (struct MHD_Daemon *daemon,
   connection->socket_fd = client_socket;
   connection->daemon = daemon;
   connection->last_activity = MHD_monotonic_time();
+  connection->connection_accepted = MHD_monotonic_ns ();
 
   /* set default connection handlers  */
   MHD_set_http_callbacks_ (connection);
@@ -1423,6 +1647,12 @@ internal_add_connection (struct MHD_Daemon *daemon,
     }
 #endif
 
+  if (NULL != daemon->notify_connection)
+    daemon->notify_connection (daemon->notify_connection_cls,
+                               connection,
+                               &connection->socket_context,
+                               MHD_CONNECTION_NOTIFY_STARTED);
+
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to acquire cleanup mutex\n");
@@ -1439,7 +1669,7 @@ internal_add_connection (struct MHD_Daemon *daemon,
   /* attempt to create handler thread */
   if (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION))
     {
-      res_thread_create = create_thread (&connection->pid, daemon,
+      res_thread_create = create_thread (&connection->pid, daemon, NULL,
 					 &MHD_handle_connection, connection);
       if (0 != res_thread_create)
         {
@@ -1514,6 +1744,11 @@ internal_add_connection (struct MHD_Daemon *daemon,
   if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
        (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
     MHD_PANIC ("Failed to release cleanup mutex\n");
+  if (NULL != daemon->notify_connection)
+    daemon->notify_connection (daemon->notify_connection_cls,
+                               connection,
+                               &connection->socket_context,
+                               MHD_CONNECTION_NOTIFY_CLOSED);
   MHD_pool_destroy (connection->pool);
   free (connection->addr);
   free (connection);
@@ -1640,6 +1875,92 @@ MHD_resume_connection (struct MHD_Connection *connection)
 }
 
 
+/**
+ * Wake up the thread processing the given connection, so that it is
+ * processed again even if its socket is not ready.
+ *
+ * @param connection the connection to process again
+ */
+void
+MHD_wake_up_connection (struct MHD_Connection *connection)
+{
+  struct MHD_Daemon *daemon;
+
+  daemon = connection->daemon;
+  if ( (MHD_YES == daemon->wake_pending) ||
+       (MHD_INVALID_PIPE_ == daemon->wpipe[1]) )
+    return;
+  daemon->wake_pending = MHD_YES;
+  if (1 != MHD_pipe_write_ (daemon->wpipe[1], "w", 1))
+    {
+#if HAVE_MESSAGES
+      MHD_DLOG (daemon,
+                "failed to signal wake up via pipe");
+#endif
+    }
+}
+
+
+/**
+ * Shut down reading of the connections waiting for a new request
+ * without having received any of its data, so that they are closed
+ * by the thread processing them.
+ *
+ * @param daemon daemon context
+ */
+static void
+shutdown_idle_connections (struct MHD_Daemon *daemon)
+{
+  struct MHD_Connection *pos;
+
+  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+       (MHD_YES != MHD_mutex_lock_ (&daemon->cleanup_connection_mutex)) )
+    MHD_PANIC ("Failed to acquire cleanup mutex\n");
+  for (pos = daemon->connections_head; NULL != pos; pos = pos->next)
+    if ( (MHD_CONNECTION_INIT == pos->state) &&
+         (0 == pos->read_buffer_offset) )
+      shutdown (pos->socket_fd, SHUT_RD);
+  if ( (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) &&
+       (MHD_YES != MHD_mutex_unlock_ (&daemon->cleanup_connection_mutex)) )
+    MHD_PANIC ("Failed to release cleanup mutex\n");
+}
+
+
+/**
+ * Close connections waiting for a new request without having received
+ * any of its data, i.e., idle keep-alive connections.
+ *
+ * @param daemon daemon whose idle connections should be closed
+ */
+void
+MHD_close_idle_connections (struct MHD_Daemon *daemon)
+{
+  struct MHD_Daemon *worker;
+  unsigned int i;
+
+  if (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION))
+    {
+      shutdown_idle_connections (daemon);
+      return;
+    }
+
+  /* the connections are owned by the worker threads, ask them */
+  for (i = 0; i < (NULL != daemon->worker_pool ? daemon->worker_pool_size : 1); i++)
+    {
+      worker = NULL != daemon->worker_pool ? &daemon->worker_pool[i] : daemon;
+      worker->close_idle = MHD_YES;
+      if ( (MHD_INVALID_PIPE_ != worker->wpipe[1]) &&
+           (1 != MHD_pipe_write_ (worker->wpipe[1], "w", 1)) )
+        {
+#if HAVE_MESSAGES
+          MHD_DLOG (worker,
+                    "failed to signal closing idle connections via pipe");
+#endif
+        }
+    }
+}
+
+
 /**
  * Run through the suspended connections and move any that are no
  * longer suspended back to the active state.
@@ -1883,6 +2204,32 @@ MHD_accept_connection (struct MHD_Daemon *daemon)
 }
 
 
+/**
+ * Accept all pending connections (up to a limit) for a daemon
+ * without a thread per connection.  Accepting only one connection
+ * per event loop iteration would keep the requests queued in the
+ * listen backlog, where their queueing delay cannot be observed.
+ *
+ * @param daemon handle with the listen socket
+ */
+static void
+MHD_accept_pending_connections (struct MHD_Daemon *daemon)
+{
+  unsigned int series_length;
+
+  if (0 != (daemon->options & MHD_USE_THREAD_PER_CONNECTION))
+    {
+      (void) MHD_accept_connection (daemon);
+      return;
+    }
+  series_length = 0;
+  while ( (MHD_YES == MHD_accept_connection (daemon)) &&
+	  (daemon->connections < daemon->connection_limit) &&
+	  (series_length < 128) )
+    series_length++;
+}
+
+
 /**
  * Free resources associated with all closed connections.
  * (destroy responses, free buffers, etc.).  All closed
@@ -2098,11 +2445,14 @@ MHD_run_from_select (struct MHD_Daemon *daemon,
   /* select connection thread handling type */
   if ( (MHD_INVALID_SOCKET != (ds = daemon->socket_fd)) &&
        (FD_ISSET (ds, read_fd_set)) )
-    (void) MHD_accept_connection (daemon);
+    MHD_accept_pending_connections (daemon);
   /* drain signaling pipe to avoid spinning select */
   if ( (MHD_INVALID_PIPE_ != daemon->wpipe[0]) &&
        (FD_ISSET (daemon->wpipe[0], read_fd_set)) )
-    (void)! MHD_pipe_read_ (daemon->wpipe[0], &tmp, sizeof (tmp));
+    {
+      (void)! MHD_pipe_read_ (daemon->wpipe[0], &tmp, sizeof (tmp));
+      daemon->wake_pending = MHD_NO;
+    }
 
   if (0 == (daemon->options & MHD_USE_THREAD_PER_CONNECTION))
     {
@@ -2230,6 +2580,7 @@ MHD_select (struct MHD_Daemon *daemon,
   if (MHD_INVALID_SOCKET == max)
     return MHD_YES;
   num_ready = MHD_SYS_select_ (max + 1, &rs, &ws, &es, tv);
+  daemon->events_received = MHD_monotonic_ns ();
   if (MHD_YES == daemon->shutdown)
     return MHD_NO;
   if (num_ready < 0)
@@ -2277,6 +2628,7 @@ MHD_poll_all (struct MHD_Daemon *daemon,
     unsigned int i;
     int timeout;
     unsigned int poll_server;
+    int poll_pipe;
     int poll_listen;
 
     poll_server = 0;
@@ -2291,11 +2643,13 @@ MHD_poll_all (struct MHD_Daemon *daemon,
 	poll_listen = (int) poll_server;
 	poll_server++;
       }
+    poll_pipe = -1;
     if (MHD_INVALID_PIPE_ != daemon->wpipe[0])
       {
 	p[poll_server].fd = daemon->wpipe[0];
 	p[poll_server].events = POLLIN;
 	p[poll_server].revents = 0;
+	poll_pipe = (int) poll_server;
 	poll_server++;
       }
     if (may_block == MHD_NO)
@@ -2343,9 +2697,18 @@ MHD_poll_all (struct MHD_Daemon *daemon,
 #endif
 	return MHD_NO;
       }
+    daemon->events_received = MHD_monotonic_ns ();
     /* handle shutdown */
     if (MHD_YES == daemon->shutdown)
       return MHD_NO;
+    /* drain signaling pipe to avoid spinning poll */
+    if ( (-1 != poll_pipe) &&
+         (0 != (p[poll_pipe].revents & POLLIN)) )
+      {
+        char tmp;
+        (void)! MHD_pipe_read_ (daemon->wpipe[0], &tmp, sizeof (tmp));
+        daemon->wake_pending = MHD_NO;
+      }
     i = 0;
     next = daemon->connections_head;
     while (NULL != (pos = next))
@@ -2380,9 +2743,15 @@ MHD_poll_all (struct MHD_Daemon *daemon,
 	    i++;
 	    break;
 	  case MHD_EVENT_LOOP_INFO_BLOCK:
+	    /* first, sanity checks */
+	    if (i >= num_connections)
+	      break; /* connection list changed somehow, retry later ... */
+	    if (p[poll_server+i].fd != pos->socket_fd)
+	      break; /* fd mismatch, something else happened, retry later ... */
 	    if (0 != (p[poll_server+i].revents & POLLIN))
 	      pos->read_handler (pos);
 	    pos->idle_handler (pos);
+	    i++;
 	    break;
 	  case MHD_EVENT_LOOP_INFO_CLEANUP:
 	    /* should never happen */
@@ -2393,7 +2762,7 @@ MHD_poll_all (struct MHD_Daemon *daemon,
     /* handle 'listen' FD */
     if ( (-1 != poll_listen) &&
 	 (0 != (p[poll_listen].revents & POLLIN)) )
-      (void) MHD_accept_connection (daemon);
+      MHD_accept_pending_connections (daemon);
   }
   return MHD_YES;
 }
@@ -2414,6 +2783,7 @@ MHD_poll_listen_socket (struct MHD_Daemon *daemon,
   int timeout;
   unsigned int poll_count;
   int poll_listen;
+  int poll_pipe;
 
   bool at_connection_limit = daemon->connections == daemon->connection_limit; // Do not accept when at connection limit, by Milan Straka
 
@@ -2428,11 +2798,13 @@ MHD_poll_listen_socket (struct MHD_Daemon *daemon,
       poll_listen = poll_count;
       poll_count++;
     }
+  poll_pipe = -1;
   if (MHD_INVALID_PIPE_ != daemon->wpipe[0])
     {
       p[poll_count].fd = daemon->wpipe[0];
       p[poll_count].events = POLLIN;
       p[poll_count].revents = 0;
+      poll_pipe = poll_count;
       poll_count++;
     }
   if (MHD_NO == may_block)
@@ -2455,6 +2827,13 @@ MHD_poll_listen_socket (struct MHD_Daemon *daemon,
   /* handle shutdown */
   if (MHD_YES == daemon->shutdown)
     return MHD_NO;
+  /* drain signaling pipe to avoid spinning poll */
+  if ( (-1 != poll_pipe) &&
+       (0 != (p[poll_pipe].revents & POLLIN)) )
+    {
+      char tmp;
+      (void)! MHD_pipe_read_ (daemon->wpipe[0], &tmp, sizeof (tmp));
+    }
   if ( (-1 != poll_listen) &&
        (0 != (p[poll_listen].revents & POLLIN)) )
     (void) MHD_accept_connection (daemon);
@@ -2594,6 +2973,7 @@ MHD_epoll (struct MHD_Daemon *daemon,
       /* update event masks */
       num_events = epoll_wait (daemon->epoll_fd,
 			       events, MAX_EVENTS, timeout_ms);
+      daemon->events_received = MHD_monotonic_ns ();
       if (-1 == num_events)
 	{
 	  if (EINTR == MHD_socket_errno_)
@@ -2768,8 +3148,18 @@ MHD_select_thread (void *cls)
 {
   struct MHD_Daemon *daemon = (struct MHD_Daemon*) cls;
 
+  /* keep the connection memory of a pinned thread on its NUMA node */
+  if ( (0 != daemon->thread_affinity_size) &&
+       (0 == (daemon->options & MHD_USE_THREAD_PER_CONNECTION)) )
+    MHD_pool_cache_bind_thread ();
+
   while (MHD_YES != daemon->shutdown)
     {
+      if (MHD_YES == daemon->close_idle)
+        {
+          daemon->close_idle = MHD_NO;
+          shutdown_idle_connections (daemon);
+        }
       if (0 != (daemon->options & MHD_USE_POLL))
 	MHD_poll (daemon, MHD_YES);
 #if EPOLL_SUPPORT
@@ -2995,6 +3385,9 @@ parse_options_va (struct MHD_Daemon *daemon,
         case MHD_OPTION_CONNECTION_MEMORY_INCREMENT:
           daemon->pool_increment= va_arg (ap, size_t);
           break;
+        case MHD_OPTION_CONNECTION_MEMORY_INITIAL:
+          daemon->pool_initial = va_arg (ap, size_t);
+          break;
         case MHD_OPTION_CONNECTION_LIMIT:
           daemon->connection_limit = va_arg (ap, unsigned int);
           break;
@@ -3006,6 +3399,11 @@ parse_options_va (struct MHD_Daemon *daemon,
             va_arg (ap, MHD_RequestCompletedCallback);
           daemon->notify_completed_cls = va_arg (ap, void *);
           break;
+        case MHD_OPTION_NOTIFY_CONNECTION:
+          daemon->notify_connection =
+            va_arg (ap, MHD_NotifyConnectionCallback);
+          daemon->notify_connection_cls = va_arg (ap, void *);
+          break;
         case MHD_OPTION_PER_IP_CONNECTION_LIMIT:
           daemon->per_ip_connection_limit = va_arg (ap, unsigned int);
           break;
@@ -3159,6 +3557,12 @@ parse_options_va (struct MHD_Daemon *daemon,
         case MHD_OPTION_THREAD_STACK_SIZE:
           daemon->thread_stack_size = va_arg (ap, size_t);
           break;
+        case MHD_OPTION_THREAD_AFFINITY:
+          daemon->thread_affinity_size = va_arg (ap, size_t);
+          daemon->thread_affinity = va_arg (ap, const struct MHD_ThreadAffinity *);
+          if (NULL == daemon->thread_affinity)
+            daemon->thread_affinity_size = 0;
+          break;
 #ifdef TCP_FASTOPEN
         case MHD_OPTION_TCP_FASTOPEN_QUEUE_SIZE:
           daemon->fastopen_queue_size = va_arg (ap, unsigned int);
@@ -3177,6 +3581,7 @@ parse_options_va (struct MHD_Daemon *daemon,
 		  /* all options taking 'size_t' */
 		case MHD_OPTION_CONNECTION_MEMORY_LIMIT:
 		case MHD_OPTION_CONNECTION_MEMORY_INCREMENT:
+		case MHD_OPTION_CONNECTION_MEMORY_INITIAL:
 		case MHD_OPTION_THREAD_STACK_SIZE:
 		  if (MHD_YES != parse_options (daemon,
 						servaddr,
@@ -3235,6 +3640,7 @@ parse_options_va (struct MHD_Daemon *daemon,
 		  break;
 		  /* all options taking two pointers */
 		case MHD_OPTION_NOTIFY_COMPLETED:
+		case MHD_OPTION_NOTIFY_CONNECTION:
 		case MHD_OPTION_URI_LOG_CALLBACK:
 		case MHD_OPTION_EXTERNAL_LOGGER:
 		case MHD_OPTION_UNESCAPE_CALLBACK:
@@ -3248,6 +3654,7 @@ parse_options_va (struct MHD_Daemon *daemon,
 		  break;
 		  /* options taking size_t-number followed by pointer */
 		case MHD_OPTION_DIGEST_AUTH_RANDOM:
+		case MHD_OPTION_THREAD_AFFINITY:
 		  if (MHD_YES != parse_options (daemon,
 						servaddr,
 						opt,
@@ -3471,6 +3878,7 @@ MHD_start_daemon_va (unsigned int flags,
   daemon->connection_limit = MHD_MAX_CONNECTIONS_DEFAULT;
   daemon->pool_size = MHD_POOL_SIZE_DEFAULT;
   daemon->pool_increment = MHD_BUF_INC_SIZE;
+  daemon->pool_initial = 0;
   daemon->unescape_callback = &unescape_wrapper;
   daemon->connection_timeout = 0;       /* no timeout */
   daemon->wpipe[0] = MHD_INVALID_PIPE_;
@@ -3909,7 +4317,7 @@ MHD_start_daemon_va (unsigned int flags,
     }
 #endif
 
-  if (MHD_YES != MHD_mutex_create_ (&daemon->per_ip_connection_mutex))
+  if (MHD_YES != MHD_ip_count_init (daemon))
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
@@ -3926,7 +4334,7 @@ MHD_start_daemon_va (unsigned int flags,
       MHD_DLOG (daemon,
                "MHD failed to initialize IP connection limit mutex\n");
 #endif
-      (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
+      MHD_ip_count_destroy (daemon);
       if ( (MHD_INVALID_SOCKET != socket_fd) &&
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
@@ -3945,7 +4353,7 @@ MHD_start_daemon_va (unsigned int flags,
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_count_destroy (daemon);
       goto free_and_fail;
     }
 #endif
@@ -3954,7 +4362,11 @@ MHD_start_daemon_va (unsigned int flags,
 	   (0 == daemon->worker_pool_size)) ) &&
        (0 == (daemon->options & MHD_USE_NO_LISTEN_SOCKET)) &&
        (0 != (res_thread_create =
-	      create_thread (&daemon->pid, daemon, &MHD_select_thread, daemon))))
+	      create_thread (&daemon->pid, daemon,
+                             ( (0 != daemon->thread_affinity_size) &&
+                               (0 == (flags & MHD_USE_THREAD_PER_CONNECTION)) )
+                             ? &daemon->thread_affinity[0] : NULL,
+                             &MHD_select_thread, daemon))))
     {
 #if HAVE_MESSAGES
       MHD_DLOG (daemon,
@@ -3962,7 +4374,7 @@ MHD_start_daemon_va (unsigned int flags,
 		MHD_strerror_ (res_thread_create));
 #endif
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_count_destroy (daemon);
       if ( (MHD_INVALID_SOCKET != socket_fd) &&
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
@@ -4022,7 +4434,9 @@ MHD_start_daemon_va (unsigned int flags,
           d->worker_pool_size = 0;
           d->worker_pool = NULL;
 
-          if ( (MHD_USE_SUSPEND_RESUME == (flags & MHD_USE_SUSPEND_RESUME)) &&
+          /* Every worker has its own pipe, so that it can be woken up
+             separately */
+          if ( (0 != (flags & (MHD_USE_SUSPEND_RESUME | MHD_USE_PIPE_FOR_SHUTDOWN))) &&
                (0 != MHD_pipe_ (d->wpipe)) )
             {
 #if HAVE_MESSAGES
@@ -4034,7 +4448,7 @@ MHD_start_daemon_va (unsigned int flags,
             }
 #ifndef WINDOWS
           if ( (0 == (flags & MHD_USE_POLL)) &&
-               (MHD_USE_SUSPEND_RESUME == (flags & MHD_USE_SUSPEND_RESUME)) &&
+               (0 != (flags & (MHD_USE_SUSPEND_RESUME | MHD_USE_PIPE_FOR_SHUTDOWN))) &&
                (d->wpipe[0] >= FD_SETSIZE) )
             {
 #if HAVE_MESSAGES
@@ -4072,7 +4486,11 @@ MHD_start_daemon_va (unsigned int flags,
 
           /* Spawn the worker thread */
           if (0 != (res_thread_create =
-		    create_thread (&d->pid, daemon, &MHD_select_thread, d)))
+		    create_thread (&d->pid, daemon,
+                                   (0 != daemon->thread_affinity_size)
+                                   ? &daemon->thread_affinity[i % daemon->thread_affinity_size]
+                                   : NULL,
+                                   &MHD_select_thread, d)))
             {
 #if HAVE_MESSAGES
               MHD_DLOG (daemon,
@@ -4099,7 +4517,7 @@ thread_failed:
 	   (0 != MHD_socket_close_ (socket_fd)) )
 	MHD_PANIC ("close failed\n");
       (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
-      (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+      MHD_ip_count_destroy (daemon);
       if (NULL != daemon->worker_pool)
         free (daemon->worker_pool);
       goto free_and_fail;
@@ -4314,7 +4732,7 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
 	       (0 != MHD_socket_close_ (daemon->worker_pool[i].epoll_fd)) )
 	    MHD_PANIC ("close failed\n");
 #endif
-          if ( (MHD_USE_SUSPEND_RESUME == (daemon->options & MHD_USE_SUSPEND_RESUME)) )
+          if (0 != (daemon->options & (MHD_USE_SUSPEND_RESUME | MHD_USE_PIPE_FOR_SHUTDOWN)))
             {
               if (MHD_INVALID_PIPE_ != daemon->worker_pool[i].wpipe[1])
                 {
@@ -4370,7 +4788,7 @@ MHD_stop_daemon (struct MHD_Daemon *daemon)
   free (daemon->nnc);
   (void) MHD_mutex_destroy_ (&daemon->nnc_lock);
 #endif
-  (void) MHD_mutex_destroy_ (&daemon->per_ip_connection_mutex);
+  MHD_ip_count_destroy (daemon);
   (void) MHD_mutex_destroy_ (&daemon->cleanup_connection_mutex);
 
   if (MHD_INVALID_PIPE_ != daemon->wpipe[1])
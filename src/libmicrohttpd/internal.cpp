@@ -208,6 +208,20 @@ MHD_monotonic_time (void)
   return time (NULL);
 }
 
+
+/**
+ * Current time of a monotonic clock in nanoseconds, using the same
+ * clock as `std::chrono::steady_clock`.
+ *
+ * @return 'current' time in nanoseconds
+ */
+uint64_t
+MHD_monotonic_ns (void)
+{
+  auto time_point = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(time_point.time_since_epoch()).count();
+}
+
 } // namespace libmicrohttpd
 } // namespace microrestd
 } // namespace ufal
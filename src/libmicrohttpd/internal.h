@@ -712,6 +712,41 @@ struct MHD_Connection
    */
   time_t last_activity;
 
+  /**
+   * Time (in nanoseconds of #MHD_monotonic_ns) when the connection
+   * was accepted.
+   */
+  uint64_t connection_accepted;
+
+  /**
+   * Time (in nanoseconds of #MHD_monotonic_ns) when the first data
+   * of the current request were found ready to be read.
+   */
+  uint64_t request_received;
+
+  /**
+   * Time (in nanoseconds of #MHD_monotonic_ns) when the last data
+   * read from the connection were found ready to be read, i.e., when
+   * the call to select/poll/epoll which delivered them returned.
+   */
+  uint64_t data_received;
+
+  /**
+   * Number of bytes received for the current request.
+   */
+  uint64_t request_bytes_received;
+
+  /**
+   * Number of bytes sent for the current request.
+   */
+  uint64_t request_bytes_sent;
+
+  /**
+   * Socket-specific client context, set by the notify_connection
+   * callback of the daemon.
+   */
+  void *socket_context;
+
   /**
    * After how many seconds of inactivity should
    * this connection time out?  Zero for no timeout.
@@ -773,6 +808,12 @@ struct MHD_Connection
    */
   unsigned int responseCode;
 
+  /**
+   * HTTP response code without flags, storage for
+   * #MHD_CONNECTION_INFO_RESPONSE_CODE.
+   */
+  unsigned int response_code;
+
   /**
    * Set to MHD_YES if the response's content reader
    * callback failed to provide data the last time
@@ -1007,6 +1048,17 @@ struct MHD_Daemon
    */
   void *notify_completed_cls;
 
+  /**
+   * Function to call when a connection is started or closed.
+   * May be NULL.
+   */
+  MHD_NotifyConnectionCallback notify_connection;
+
+  /**
+   * Closure argument to notify_connection.
+   */
+  void *notify_connection_cls;
+
   /**
    * Function to call with the full URI at the
    * beginning of request processing.  May be NULL.
@@ -1055,9 +1107,10 @@ struct MHD_Daemon
   struct MHD_Daemon *worker_pool;
 
   /**
-   * Table storing number of connections per IP
+   * Sharded hash table storing number of connections per IP,
+   * NULL if there is no per-IP connection limit
    */
-  void *per_ip_connection_count;
+  struct MHD_IPCountShard *per_ip_connection_count;
 
   /**
    * Size of the per-connection memory pools.
@@ -1069,25 +1122,42 @@ struct MHD_Daemon
    */
   size_t pool_increment;
 
+  /**
+   * Initial size of the per-connection read buffer, 0 for half
+   * of the pool size.
+   */
+  size_t pool_initial;
+
   /**
    * Size of threads created by MHD.
    */
   size_t thread_stack_size;
 
+  /**
+   * CPU sets of the worker threads, only valid in #MHD_start_daemon.
+   */
+  const struct MHD_ThreadAffinity *thread_affinity;
+
+  /**
+   * Number of the CPU sets in thread_affinity, 0 when not pinned.
+   */
+  size_t thread_affinity_size;
+
   /**
    * Number of worker daemons
    */
   unsigned int worker_pool_size;
 
   /**
-   * The select thread handle (if we have internal select)
+   * Time (in nanoseconds of #MHD_monotonic_ns) when the last call
+   * to select/poll/epoll of this daemon returned.
    */
-  MHD_thread_handle_ pid;
+  uint64_t events_received;
 
   /**
-   * Mutex for per-IP connection counts.
+   * The select thread handle (if we have internal select)
    */
-  MHD_mutex_ per_ip_connection_mutex;
+  MHD_thread_handle_ pid;
 
   /**
    * Mutex for (modifying) access to the "cleanup" connection DLL.
@@ -1140,6 +1210,18 @@ struct MHD_Daemon
    */
   int resuming;
 
+  /**
+   * Has the thread been woken up by #MHD_wake_up_connection and not yet
+   * processed its connections?
+   */
+  volatile int wake_pending;
+
+  /**
+   * Should the thread close its idle connections, as requested
+   * by #MHD_close_idle_connections?
+   */
+  volatile int close_idle;
+
   /**
    * Number of active parallel connections.
    */
@@ -1422,6 +1504,16 @@ time_t
 MHD_monotonic_time(void);
 
 
+/**
+ * Current time of a monotonic clock in nanoseconds, using the same
+ * clock as `std::chrono::steady_clock`.
+ *
+ * @return 'current' time in nanoseconds
+ */
+uint64_t
+MHD_monotonic_ns(void);
+
+
 /**
  * Convert all occurences of '+' to ' '.
  *
@@ -29,6 +29,10 @@
  */
 #include "memorypool.h"
 
+#if MHD_POOL_CACHE_SIZE
+#include <mutex>
+#endif
+
 namespace ufal {
 namespace microrestd {
 namespace libmicrohttpd {
@@ -83,9 +87,130 @@ struct MemoryPool
    * #MHD_NO if pool was malloc'ed, #MHD_YES if mmapped (VirtualAlloc'ed for W32).
    */
   int is_mmap;
+
+  /**
+   * Next released pool in a pool cache.
+   */
+  struct MemoryPool *next;
 };
 
 
+/**
+ * Free the memory of a pool.
+ *
+ * @param pool memory pool to free
+ */
+static void
+pool_free (struct MemoryPool *pool)
+{
+  if (pool->is_mmap == MHD_NO)
+    free (pool->memory);
+  else
+#if defined(MAP_ANONYMOUS) && !defined(_WIN32)
+    munmap (pool->memory, pool->size);
+#elif defined(_WIN32)
+    VirtualFree(pool->memory, 0, MEM_RELEASE);
+#else
+    abort();
+#endif
+  free (pool);
+}
+
+
+#if MHD_POOL_CACHE_SIZE
+/**
+ * Cache of released pools, so that the memory of closed connections
+ * can be reused without returning it to the system.  Every thread has
+ * its own cache; when a thread exits, its pools are moved to a shared
+ * cache, which is used when the cache of a thread is empty (i.e., when
+ * connections are created and destroyed by different threads).
+ */
+struct MemoryPoolCache
+{
+  MemoryPoolCache (int shared) : head (NULL), count (0), shared (shared) {}
+  ~MemoryPoolCache ();
+
+  /**
+   * Take a pool of the given size from the cache.
+   *
+   * @param max size of the pool
+   * @return NULL if there is no such pool
+   */
+  struct MemoryPool *take (size_t max);
+
+  /**
+   * Put a pool to the cache.
+   *
+   * @param pool memory pool to put
+   * @return #MHD_NO if the cache is full
+   */
+  int put (struct MemoryPool *pool);
+
+  struct MemoryPool *head;
+  unsigned int count;
+  int shared;
+};
+
+static std::mutex shared_pool_cache_mutex;
+static struct MemoryPoolCache shared_pool_cache (MHD_YES);
+static thread_local struct MemoryPoolCache thread_pool_cache (MHD_NO);
+static thread_local int thread_pool_cache_bound = MHD_NO;
+
+MemoryPoolCache::~MemoryPoolCache ()
+{
+  struct MemoryPool *pool;
+
+  while (NULL != (pool = head))
+    {
+      head = pool->next;
+      if (MHD_NO == shared)
+        {
+          std::lock_guard<std::mutex> lock (shared_pool_cache_mutex);
+          if (MHD_YES == shared_pool_cache.put (pool))
+            continue;
+        }
+      pool_free (pool);
+    }
+}
+
+struct MemoryPool *
+MemoryPoolCache::take (size_t max)
+{
+  struct MemoryPool **pos;
+  struct MemoryPool *pool;
+
+  for (pos = &head; NULL != *pos; pos = &(*pos)->next)
+    if ((*pos)->size == max)
+      {
+        pool = *pos;
+        *pos = pool->next;
+        count--;
+        return pool;
+      }
+  return NULL;
+}
+
+int
+MemoryPoolCache::put (struct MemoryPool *pool)
+{
+  if (count >= MHD_POOL_CACHE_SIZE)
+    return MHD_NO;
+  /* unallocated memory of a pool is always zeroed, so clear the used parts */
+  memset (pool->memory, 0, pool->pos);
+  memset (&pool->memory[pool->end], 0, pool->size - pool->end);
+#if defined(MHD_POOL_CACHE_MADV_FREE) && defined(MADV_FREE)
+  /* let the system reclaim the pages of an idle pool lazily */
+  if (MHD_YES == pool->is_mmap)
+    madvise (pool->memory, pool->size, MADV_FREE);
+#endif
+  pool->next = head;
+  head = pool;
+  count++;
+  return MHD_YES;
+}
+#endif
+
+
 /**
  * Create a memory pool.
  *
@@ -97,6 +222,20 @@ MHD_pool_create (size_t max)
 {
   struct MemoryPool *pool;
 
+#if MHD_POOL_CACHE_SIZE
+  pool = thread_pool_cache.take (max);
+  if ( (NULL == pool) && (MHD_NO == thread_pool_cache_bound) )
+    {
+      std::lock_guard<std::mutex> lock (shared_pool_cache_mutex);
+      pool = shared_pool_cache.take (max);
+    }
+  if (NULL != pool)
+    {
+      pool->pos = 0;
+      pool->end = max;
+      return pool;
+    }
+#endif
   pool = (struct MemoryPool*) malloc (sizeof (struct MemoryPool));
   if (NULL == pool)
     return NULL;
@@ -131,12 +270,14 @@ MHD_pool_create (size_t max)
   pool->pos = 0;
   pool->end = max;
   pool->size = max;
+  pool->next = NULL;
   return pool;
 }
 
 
 /**
- * Destroy a memory pool.
+ * Destroy a memory pool.  Unless the pool cache of the
+ * current thread is full, the pool is kept there for reuse.
  *
  * @param pool memory pool to destroy
  */
@@ -145,17 +286,24 @@ MHD_pool_destroy (struct MemoryPool *pool)
 {
   if (pool == NULL)
     return;
-  if (pool->is_mmap == MHD_NO)
-    free (pool->memory);
-  else
-#if defined(MAP_ANONYMOUS) && !defined(_WIN32)
-    munmap (pool->memory, pool->size);
-#elif defined(_WIN32)
-    VirtualFree(pool->memory, 0, MEM_RELEASE);
-#else
-    abort();
+#if MHD_POOL_CACHE_SIZE
+  if (MHD_YES == thread_pool_cache.put (pool))
+    return;
+#endif
+  pool_free (pool);
+}
+
+
+/**
+ * Create new pools of the calling thread only from its own cache or
+ * from fresh memory, not from pools released by other threads.
+ */
+void
+MHD_pool_cache_bind_thread (void)
+{
+#if MHD_POOL_CACHE_SIZE
+  thread_pool_cache_bound = MHD_YES;
 #endif
-  free (pool);
 }
 
 
@@ -272,7 +420,7 @@ MHD_pool_reset (struct MemoryPool *pool,
 		void *keep,
 		size_t size)
 {
-  size = ROUND_TO_ALIGN (size);
+  size = (NULL != keep) ? ROUND_TO_ALIGN (size) : 0;
   if (NULL != keep)
     {
       if (keep != pool->memory)
@@ -280,12 +428,20 @@ MHD_pool_reset (struct MemoryPool *pool,
           memmove (pool->memory, keep, size);
           keep = pool->memory;
         }
-      pool->pos = size;
     }
+  /* unallocated memory is always zeroed, so clear only the used parts,
+     without touching pages of the pool which have never been used */
+  if (pool->pos > size)
+    memset (&pool->memory[size],
+            0,
+            pool->pos - size);
+  if (pool->end < size)
+    pool->end = size; /* keep was moved over the end allocations */
+  memset (&pool->memory[pool->end],
+          0,
+          pool->size - pool->end);
+  pool->pos = size;
   pool->end = pool->size;
-  memset (&pool->memory[size],
-	  0,
-	  pool->size - size);
   return keep;
 }
 
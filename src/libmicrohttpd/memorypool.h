@@ -48,7 +48,8 @@ struct MemoryPool;
 
 
 /**
- * Create a memory pool.
+ * Create a memory pool, reusing a released pool
+ * of the same size if available.
  *
  * @param max maximum size of the pool
  * @return NULL on error
@@ -58,7 +59,7 @@ MHD_pool_create (size_t max);
 
 
 /**
- * Destroy a memory pool.
+ * Destroy a memory pool (possibly keeping it for reuse).
  *
  * @param pool memory pool to destroy
  */
@@ -66,6 +67,15 @@ void
 MHD_pool_destroy (struct MemoryPool *pool);
 
 
+/**
+ * Create new pools of the calling thread only from its own cache or
+ * from fresh memory, not from pools released by other threads, so that
+ * the pools stay on the NUMA node of the (pinned) thread.
+ */
+void
+MHD_pool_cache_bind_thread (void);
+
+
 /**
  * Allocate size bytes from the pool.
  *
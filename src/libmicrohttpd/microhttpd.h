@@ -271,6 +271,7 @@ typedef SOCKET MHD_socket;
 #define MHD_HTTP_FAILED_DEPENDENCY 424
 #define MHD_HTTP_UNORDERED_COLLECTION 425
 #define MHD_HTTP_UPGRADE_REQUIRED 426
+#define MHD_HTTP_TOO_MANY_REQUESTS 429
 #define MHD_HTTP_NO_RESPONSE 444
 #define MHD_HTTP_RETRY_WITH 449
 #define MHD_HTTP_BLOCKED_BY_WINDOWS_PARENTAL_CONTROLS 450
@@ -864,6 +865,38 @@ enum MHD_OPTION
    * This option must be followed by a `unsigned int` argument.
    */
   MHD_OPTION_LISTENING_ADDRESS_REUSE = 25,
+
+  /**
+   * Initial size of the read buffer of a connection (followed by
+   * a `size_t`).  The read buffer then grows (by doubling or by
+   * #MHD_OPTION_CONNECTION_MEMORY_INCREMENT) only when needed, up
+   * to the #MHD_OPTION_CONNECTION_MEMORY_LIMIT.  Default is 0, which
+   * uses half of the #MHD_OPTION_CONNECTION_MEMORY_LIMIT.
+   */
+  MHD_OPTION_CONNECTION_MEMORY_INITIAL = 26,
+
+  /**
+   * Register a function that should be called whenever a connection is
+   * started or closed.
+   *
+   * This option should be followed by TWO pointers.  First a pointer
+   * to a function of type #MHD_NotifyConnectionCallback and second a
+   * pointer to a closure to pass to the connection notification callback.
+   * The second pointer maybe NULL.
+   */
+  MHD_OPTION_NOTIFY_CONNECTION = 27,
+
+  /**
+   * CPUs the threads of the thread pool (or the single internal select
+   * thread) may run on; threads of #MHD_USE_THREAD_PER_CONNECTION are
+   * not affected.  This option should be followed by a `size_t` number
+   * of CPU sets and a `const struct MHD_ThreadAffinity *` array of them;
+   * worker i is restricted to the set i modulo their number.  The array
+   * is used only during #MHD_start_daemon.  Pinned workers allocate
+   * connection memory only locally, so that it stays on their NUMA node.
+   * Supported only on Linux, ignored elsewhere.
+   */
+  MHD_OPTION_THREAD_AFFINITY = 28,
 };
 
 
@@ -894,6 +927,23 @@ struct MHD_OptionItem
 };
 
 
+/**
+ * Set of CPUs a thread may run on, see #MHD_OPTION_THREAD_AFFINITY.
+ */
+struct MHD_ThreadAffinity
+{
+  /**
+   * Indices of the CPUs.
+   */
+  const unsigned int *cpus;
+
+  /**
+   * Number of the CPUs.
+   */
+  unsigned int cpus_size;
+};
+
+
 /**
  * The `enum MHD_ValueKind` specifies the source of
  * the key-value pairs in the HTTP protocol.
@@ -997,6 +1047,29 @@ enum MHD_RequestTerminationCode
 };
 
 
+/**
+ * The `enum MHD_ConnectionNotificationCode` specifies types
+ * of connection notifications.
+ * @ingroup request
+ */
+enum MHD_ConnectionNotificationCode
+{
+
+  /**
+   * A new connection has been started.
+   * @ingroup request
+   */
+  MHD_CONNECTION_NOTIFY_STARTED = 0,
+
+  /**
+   * The connection has been closed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_NOTIFY_CLOSED = 1
+
+};
+
+
 /**
  * Information about a connection.
  */
@@ -1038,6 +1111,41 @@ union MHD_ConnectionInfo
    * daemons running).
    */
   struct MHD_Daemon *daemon;
+
+  /**
+   * Time in nanoseconds of a monotonic clock (the one used by
+   * `std::chrono::steady_clock`) when the data of the current request
+   * were found ready to be read.
+   */
+  uint64_t request_received;
+
+  /**
+   * Time in nanoseconds of the same monotonic clock when the
+   * connection was accepted.
+   */
+  uint64_t connection_accepted;
+
+  /**
+   * Time in nanoseconds of the same monotonic clock when the last
+   * data read from the connection were found ready to be read.
+   */
+  uint64_t data_received;
+
+  /**
+   * Socket-specific client context, as set by the
+   * #MHD_NotifyConnectionCallback.
+   */
+  void *socket_context;
+
+  /**
+   * HTTP status code of the response.
+   */
+  unsigned int response_code;
+
+  /**
+   * Number of bytes received or sent.
+   */
+  uint64_t bytes;
 };
 
 
@@ -1096,7 +1204,68 @@ enum MHD_ConnectionInfoType
    * No extra arguments should be passed.
    * @ingroup request
    */
-  MHD_CONNECTION_INFO_CONNECTION_FD
+  MHD_CONNECTION_INFO_CONNECTION_FD,
+
+  /**
+   * Get the time when the data of the current request were found
+   * ready to be read, see `request_received` of #MHD_ConnectionInfo.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_REQUEST_RECEIVED,
+
+  /**
+   * Returns the client-specific pointer to a `void *` that was (possibly)
+   * set during a #MHD_NotifyConnectionCallback when the socket was
+   * first accepted.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_SOCKET_CONTEXT,
+
+  /**
+   * Get the HTTP status code of the response queued for the current
+   * request, or 0 if there is none, see `response_code` of
+   * #MHD_ConnectionInfo.  Valid also in #MHD_RequestCompletedCallback.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_RESPONSE_CODE,
+
+  /**
+   * Get the number of bytes received (including the headers) for the
+   * current request, see `bytes` of #MHD_ConnectionInfo.  Valid also in
+   * #MHD_RequestCompletedCallback.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_BYTES_RECEIVED,
+
+  /**
+   * Get the number of bytes sent (including the headers) for the current
+   * request, see `bytes` of #MHD_ConnectionInfo.  Valid also in
+   * #MHD_RequestCompletedCallback.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_BYTES_SENT,
+
+  /**
+   * Get the time when the connection was accepted, see
+   * `connection_accepted` of #MHD_ConnectionInfo.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_CONNECTION_ACCEPTED,
+
+  /**
+   * Get the time when the last data read from the connection were
+   * found ready to be read (for a complete request, when its last
+   * data were), see `data_received` of #MHD_ConnectionInfo.
+   * No extra arguments should be passed.
+   * @ingroup request
+   */
+  MHD_CONNECTION_INFO_DATA_RECEIVED
 
 };
 
@@ -1236,6 +1405,32 @@ typedef void
                                  enum MHD_RequestTerminationCode toe);
 
 
+/**
+ * Signature of the callback used by MHD to notify the application
+ * about started/stopped connections
+ *
+ * @param cls client-defined closure
+ * @param connection connection handle
+ * @param socket_context socket-specific pointer where the
+ *                       client can associate some state specific
+ *                       to the TCP connection; note that this is
+ *                       different from the "con_cls" which is per
+ *                       HTTP request.  The client can initialize
+ *                       during #MHD_CONNECTION_NOTIFY_STARTED and
+ *                       cleanup during #MHD_CONNECTION_NOTIFY_CLOSED
+ *                       and access in the meantime using
+ *                       #MHD_CONNECTION_INFO_SOCKET_CONTEXT.
+ * @param toe reason for connection notification
+ * @see #MHD_OPTION_NOTIFY_CONNECTION
+ * @ingroup request
+ */
+typedef void
+(*MHD_NotifyConnectionCallback) (void *cls,
+                                 struct MHD_Connection *connection,
+                                 void **socket_context,
+                                 enum MHD_ConnectionNotificationCode toe);
+
+
 /**
  * Iterator over key-value pairs.  This iterator
  * can be used to iterate over all of the cookies,
@@ -1782,6 +1977,37 @@ _MHD_EXTERN void
 MHD_resume_connection (struct MHD_Connection *connection);
 
 
+/**
+ * Wake up the thread processing the given connection, so that it is
+ * processed again even if its socket is not ready.  This is useful when
+ * a content reader callback returned 0 because no data were available,
+ * and now more data are ready.  It is safe to call this function from
+ * any thread while the connection exists; multiple wake ups of the same
+ * thread are coalesced.  Only works with #MHD_USE_SELECT_INTERNALLY
+ * together with #MHD_USE_PIPE_FOR_SHUTDOWN.
+ *
+ * @param connection the connection to process again
+ */
+_MHD_EXTERN void
+MHD_wake_up_connection (struct MHD_Connection *connection);
+
+
+/**
+ * Close connections waiting for a new request without having received
+ * any of its data, i.e., idle keep-alive connections.  The connections
+ * are shut down for reading and then closed by the threads processing
+ * them.  Useful after #MHD_quiesce_daemon to finish the remaining
+ * connections.  It is safe to call this function from any thread;
+ * requires #MHD_USE_THREAD_PER_CONNECTION, or #MHD_USE_SELECT_INTERNALLY
+ * together with #MHD_USE_PIPE_FOR_SHUTDOWN.
+ *
+ * @param daemon daemon whose idle connections should be closed
+ * @ingroup specialized
+ */
+_MHD_EXTERN void
+MHD_close_idle_connections (struct MHD_Daemon *daemon);
+
+
 /* **************** Response manipulation functions ***************** */
 
 
@@ -100,7 +100,7 @@ static const char *const four_hundred[] = {
   "Upgrade Required",
   "Unknown",
   "Unknown",
-  "Unknown",
+  "Too Many Requests",
   "Unknown", /* 430 */
   "Unknown",
   "Unknown",
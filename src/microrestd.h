@@ -9,12 +9,18 @@
 
 #pragma once
 
+#include "rest_server/file_response_generator.h"
 #include "rest_server/json_builder.h"
+#include "rest_server/json_fragment_cache.h"
 #include "rest_server/json_response_generator.h"
+#include "rest_server/request_arena.h"
+#include "rest_server/request_limits.h"
 #include "rest_server/response_generator.h"
 #include "rest_server/rest_request.h"
+#include "rest_server/rest_router.h"
 #include "rest_server/rest_service.h"
 #include "rest_server/rest_server.h"
+#include "rest_server/sse_response_generator.h"
 #include "rest_server/string_piece.h"
 #include "rest_server/version.h"
 #include "rest_server/xml_builder.h"
@@ -0,0 +1,105 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "async_log_writer.h"
+
+namespace ufal {
+namespace microrestd {
+
+void async_log_writer::start(unsigned capacity, batch_writer write_batch) {
+  stop();
+
+  // Use a power-of-two capacity.
+  size_t size = 2;
+  while (size < capacity) size <<= 1;
+
+  cells.reset(new cell[size]);
+  for (size_t i = 0; i < size; i++)
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+  mask = size - 1;
+  enqueue_position.store(0, std::memory_order_relaxed);
+  dequeue_position = 0;
+
+  this->write_batch = write_batch;
+  stopping = false;
+  writer = std::thread(&async_log_writer::write_lines, this);
+  active.store(true, std::memory_order_release);
+}
+
+void async_log_writer::stop() {
+  if (!writer.joinable()) return;
+
+  active.store(false, std::memory_order_release);
+  {
+    std::lock_guard<std::mutex> lock(writer_mutex);
+    stopping = true;
+  }
+  writer_wakeup.notify_one();
+  writer.join();
+  cells.reset();
+}
+
+bool async_log_writer::push(std::string&& line) {
+  // A bounded MPMC queue by Dmitry Vyukov; the sequence of a cell is its
+  // position when it is free and its position + 1 when it is filled.
+  size_t position = enqueue_position.load(std::memory_order_relaxed);
+  cell* target;
+  for (;;) {
+    target = &cells[position & mask];
+    size_t sequence = target->sequence.load(std::memory_order_acquire);
+    if (sequence == position) {
+      if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+    } else if (sequence < position) {
+      dropped_lines.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    } else {
+      position = enqueue_position.load(std::memory_order_relaxed);
+    }
+  }
+
+  target->line = std::move(line);
+  target->sequence.store(position + 1, std::memory_order_release);
+  return true;
+}
+
+bool async_log_writer::pop(std::string& line) {
+  cell& source = cells[dequeue_position & mask];
+  if (source.sequence.load(std::memory_order_acquire) != dequeue_position + 1) return false;
+
+  line = std::move(source.line);
+  source.line.clear();
+  source.sequence.store(dequeue_position + mask + 1, std::memory_order_release);
+  dequeue_position++;
+  return true;
+}
+
+void async_log_writer::write_lines() {
+  std::vector<std::string> batch;
+  std::string line;
+
+  for (bool finish = false; ; ) {
+    batch.clear();
+    while (batch.size() < max_batch && pop(line))
+      batch.push_back(std::move(line));
+
+    if (!batch.empty()) {
+      write_batch(batch);
+      continue;
+    }
+    if (finish) break;
+
+    // Producers do not notify, so check the buffer periodically; after
+    // stopping, drain the buffer once more.
+    std::unique_lock<std::mutex> lock(writer_mutex);
+    finish = writer_wakeup.wait_for(lock, std::chrono::milliseconds(10), [this]{ return stopping; });
+  }
+}
+
+} // namespace microrestd
+} // namespace ufal
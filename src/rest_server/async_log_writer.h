@@ -0,0 +1,68 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ufal {
+namespace microrestd {
+
+// Log lines pushed by any thread into a bounded lock-free ring buffer
+// and written in batches by a background thread. When the buffer is full,
+// the lines are dropped and counted.
+class async_log_writer {
+ public:
+  typedef std::function<void(const std::vector<std::string>& lines)> batch_writer;
+
+  ~async_log_writer() { stop(); }
+
+  void start(unsigned capacity, batch_writer write_batch);
+  void stop();
+  bool running() const { return active.load(std::memory_order_acquire); }
+
+  // Push a line to the buffer, return false if it was dropped.
+  bool push(std::string&& line);
+  uint64_t dropped() const { return dropped_lines.load(std::memory_order_relaxed); }
+
+ private:
+  enum { max_batch = 256 };
+
+  struct cell {
+    std::atomic<size_t> sequence;
+    std::string line;
+  };
+
+  bool pop(std::string& line);
+  void write_lines();
+
+  std::unique_ptr<cell[]> cells;
+  size_t mask = 0;
+  std::atomic<size_t> enqueue_position{0};
+  size_t dequeue_position = 0;
+  std::atomic<uint64_t> dropped_lines{0};
+
+  batch_writer write_batch;
+  std::thread writer;
+  std::atomic<bool> active{false};
+  std::mutex writer_mutex;
+  std::condition_variable writer_wakeup;
+  bool stopping = false;
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,63 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "file_response_generator.h"
+
+namespace ufal {
+namespace microrestd {
+
+file_response_generator::file_response_generator(const char* filename) : file(filename, std::ifstream::binary), length(0) {
+  if (file.is_open() && file.seekg(0, std::ifstream::end)) {
+    length = uint64_t(file.tellg());
+    file.seekg(0, std::ifstream::beg);
+  }
+}
+
+bool file_response_generator::is_open() const {
+  return file.is_open() && file.good();
+}
+
+bool file_response_generator::generate() {
+  if (!file) return false;
+
+  size_t data_size = data.size();
+  data.resize(data_size + (32 << 10));
+  file.read(data.data() + data_size, 32 << 10);
+  data.resize(data_size + file.gcount());
+
+  return file.gcount() > 0;
+}
+
+string_piece file_response_generator::current() const {
+  return string_piece(data.data(), data.size());
+}
+
+void file_response_generator::consume(size_t length) {
+  if (length >= data.size()) data.clear();
+  else if (length) data.erase(data.begin(), data.begin() + length);
+}
+
+bool file_response_generator::seekable(uint64_t& length) const {
+  if (!file.is_open()) return false;
+
+  length = this->length;
+  return true;
+}
+
+bool file_response_generator::seek(uint64_t offset) {
+  if (!file.is_open() || offset > length) return false;
+
+  file.clear();
+  if (!file.seekg(std::streamoff(offset), std::ifstream::beg)) return false;
+  data.clear();
+  return true;
+}
+
+} // namespace microrestd
+} // namespace ufal
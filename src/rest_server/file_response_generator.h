@@ -0,0 +1,40 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <fstream>
+#include <vector>
+
+#include "response_generator.h"
+
+namespace ufal {
+namespace microrestd {
+
+class file_response_generator : public response_generator {
+ public:
+  file_response_generator(const char* filename);
+
+  bool is_open() const;
+
+  virtual bool generate() override;
+  virtual string_piece current() const override;
+  virtual void consume(size_t length) override;
+
+  virtual bool seekable(uint64_t& length) const override;
+  virtual bool seek(uint64_t offset) override;
+
+ private:
+  std::ifstream file;
+  uint64_t length;
+  std::vector<char> data;
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,55 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cctype>
+
+#include "http_helpers.h"
+
+namespace ufal {
+namespace microrestd {
+
+bool http_helpers::valid_utf8(const std::string& text) {
+  for (auto str = (const unsigned char*) text.c_str(); *str; str++)
+    if (*str >= 0x80) {
+      if (*str < 0xC0) return false;
+      else if (*str < 0xE0) {
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+      } else if (*str < 0xF0) {
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+      } else if (*str < 0xF8) {
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+        str++; if (*str < 0x80 || *str >= 0xC0) return false;
+      } else return false;
+    }
+
+  return true;
+}
+
+bool http_helpers::http_value_compare(const char* string, const char* pattern) {
+  // While there are pattern characters.
+  while (*pattern) {
+    // Skip spaces.
+    while (*string && isspace((unsigned char) *string)) string++;
+    if (!*string) return false;
+
+    // Match the next character ignoring case.
+    if (tolower((unsigned char) *string++) != tolower((unsigned char) *pattern++)) return false;
+  }
+
+  // Skip final spaces.
+  while (*string && isspace((unsigned char) *string)) string++;
+
+  // Succeed if there are no characters in string left or if there is a semicolon.
+  return !*string || *string == ';';
+}
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,27 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <string>
+
+namespace ufal {
+namespace microrestd {
+
+// Validation and comparison of texts received in HTTP requests.
+struct http_helpers {
+  static bool valid_utf8(const std::string& text);
+
+  // Compare an HTTP header value to a pattern ignoring case and spaces,
+  // allowing the value to continue with parameters after a semicolon.
+  static bool http_value_compare(const char* string, const char* pattern);
+};
+
+} // namespace microrestd
+} // namespace ufal
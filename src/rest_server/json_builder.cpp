@@ -7,8 +7,17 @@
 // License, v. 2.0. If a copy of the MPL was not distributed with this
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
+#include <cfloat>
+#include <cstdio>
+#include <cstdlib>
+
 #include "json_builder.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MICRORESTD_JSON_BUILDER_SSE2
+#endif
+
 namespace ufal {
 namespace microrestd {
 
@@ -17,14 +26,48 @@ const char* json_builder::mime = "application/json";
 void json_builder::discard_current_prefix(size_t length) {
   if (!length) return;
 
-  if (length < json.size())
-    json.erase(json.begin(), json.begin() + length);
-  else
+  // Skip the prefix, compacting only when it is longer than the rest of the
+  // buffer, so that the erase is amortized over the discarded data.
+  if (length < json.size() - json_offset) {
+    json_offset += length;
+    if (json_offset >= json.size() - json_offset) {
+      json.erase(json.begin(), json.begin() + json_offset);
+      json_offset = 0;
+    }
+  } else {
     json.clear();
+    json_offset = 0;
+  }
+}
+
+// Return the length of the prefix not requiring escaping, i.e., without
+// control characters, quotes and backslashes.
+static inline size_t unescaped_prefix(const char* str, size_t len) {
+  size_t prefix = 0;
+
+#ifdef MICRORESTD_JSON_BUILDER_SSE2
+  const __m128i control_max = _mm_set1_epi8(0x1F), quote = _mm_set1_epi8('"'), backslash = _mm_set1_epi8('\\');
+  for (; prefix + 16 <= len; prefix += 16) {
+    __m128i chars = _mm_loadu_si128((const __m128i*) (str + prefix));
+    __m128i escaped = _mm_or_si128(_mm_cmpeq_epi8(_mm_subs_epu8(chars, control_max), _mm_setzero_si128()),
+                                   _mm_or_si128(_mm_cmpeq_epi8(chars, quote), _mm_cmpeq_epi8(chars, backslash)));
+    if (_mm_movemask_epi8(escaped)) break;
+  }
+#endif
+
+  while (prefix < len && ((unsigned char) str[prefix]) >= 32 && str[prefix] != '"' && str[prefix] != '\\')
+    prefix++;
+  return prefix;
 }
 
 void json_builder::encode(string_piece str) {
-  for (; str.len; str.str++, str.len--)
+  while (str.len) {
+    // Copy the longest prefix not requiring escaping at once
+    size_t unescaped = unescaped_prefix(str.str, str.len);
+    json.insert(json.end(), str.str, str.str + unescaped);
+    str.str += unescaped, str.len -= unescaped;
+    if (!str.len) break;
+
     switch (*str.str) {
       case '"': json.push_back('\\'); json.push_back('\"'); break;
       case '\\': json.push_back('\\'); json.push_back('\\'); break;
@@ -34,12 +77,52 @@ void json_builder::encode(string_piece str) {
       case '\r': json.push_back('\\'); json.push_back('r'); break;
       case '\t': json.push_back('\\'); json.push_back('t'); break;
       default:
-        if (((unsigned char)*str.str) < 32) {
-          json.push_back('u'); json.push_back('0'); json.push_back('0'); json.push_back('0' + (*str.str >> 4)); json.push_back("0123456789ABCDEF"[*str.str & 0xF]);
-        } else {
-          json.push_back(*str.str);
-        }
+        json.push_back('\\'); json.push_back('u'); json.push_back('0'); json.push_back('0'); json.push_back('0' + (*str.str >> 4)); json.push_back("0123456789ABCDEF"[*str.str & 0xF]);
     }
+    str.str++, str.len--;
+  }
+}
+
+void json_builder::encode_integer(unsigned long long number, bool negative) {
+  char digits[20/*2^64*/ + 1/*-*/];
+  char* start = digits + sizeof(digits);
+  do {
+    *--start = '0' + number % 10;
+    number /= 10;
+  } while (number);
+  if (negative) *--start = '-';
+
+  json.insert(json.end(), start, digits + sizeof(digits));
+}
+
+void json_builder::encode_double(double number, int precision) {
+  // JSON cannot represent infinities and NaNs
+  if (number != number || number - number != 0) {
+    json.push_back('n'); json.push_back('u'); json.push_back('l'); json.push_back('l');
+    return;
+  }
+
+  // Without a precision, use the shortest representation which parses back
+  // to the same number. For normal numbers, if any representation with at most
+  // 15 significant digits does, %.15g produces it (without trailing zeros),
+  // so fewer digits need to be tried only for subnormal numbers.
+  char formatted[32];
+  int length = 0;
+  if (precision > 0) {
+    length = snprintf(formatted, sizeof(formatted), "%.*g", precision < 17 ? precision : 17, number);
+  } else {
+    bool subnormal = number != 0 && number < DBL_MIN && number > -DBL_MIN;
+    for (int digits = subnormal ? 1 : 15; digits <= 17; digits++) {
+      length = snprintf(formatted, sizeof(formatted), "%.*g", digits, number);
+      if (digits == 17 || strtod(formatted, nullptr) == number) break;
+    }
+  }
+
+  // Use a decimal point independently on the locale
+  for (int i = 0; i < length; i++)
+    if (formatted[i] == ',') formatted[i] = '.';
+
+  json.insert(json.end(), formatted, formatted + length);
 }
 
 void json_builder::encode_xml_escape(string_piece str) {
@@ -57,7 +140,7 @@ void json_builder::encode_xml_escape(string_piece str) {
       case '\t': json.push_back('\\'); json.push_back('t'); break;
       default:
         if (((unsigned char)*str.str) < 32) {
-          json.push_back('u'); json.push_back('0'); json.push_back('0'); json.push_back('0' + (*str.str >> 4)); json.push_back("0123456789ABCDEF"[*str.str & 0xF]);
+          json.push_back('\\'); json.push_back('u'); json.push_back('0'); json.push_back('0'); json.push_back('0' + (*str.str >> 4)); json.push_back("0123456789ABCDEF"[*str.str & 0xF]);
         } else {
           json.push_back(*str.str);
         }
@@ -27,11 +27,19 @@ class json_builder {
   inline json_builder& object();
   inline json_builder& array();
   inline json_builder& key(string_piece str);
+  inline json_builder& key_raw(string_piece str);
   inline json_builder& value(string_piece str, bool append = false);
   inline json_builder& value(int number);
+  inline json_builder& value(unsigned number);
+  inline json_builder& value(long number);
+  inline json_builder& value(unsigned long number);
+  inline json_builder& value(long long number);
+  inline json_builder& value(unsigned long long number);
+  inline json_builder& value(double number, int precision = 0);
   inline json_builder& value_bool(bool boolean);
   inline json_builder& value(std::nullptr_t null);
   inline json_builder& value_xml_escape(string_piece str, bool append = false);
+  inline json_builder& value_raw(string_piece str);
   inline json_builder& indent();
   inline json_builder& close();
   inline json_builder& finish(bool indent = false);
@@ -52,8 +60,11 @@ class json_builder {
   inline void normalize_mode(bool start_value);
   void encode(string_piece str);
   void encode_xml_escape(string_piece str);
+  void encode_integer(unsigned long long number, bool negative);
+  void encode_double(double number, int precision);
 
   std::vector<char> json;
+  size_t json_offset = 0;
   std::vector<char> stack;
   mode_t mode = NORMAL;
   bool need_indent = false;
@@ -63,6 +74,7 @@ class json_builder {
 // Definitions
 json_builder& json_builder::clear() {
   json.clear();
+  json_offset = 0;
   stack.clear();
   mode = NORMAL;
   need_indent = false;
@@ -92,6 +104,15 @@ json_builder& json_builder::key(string_piece str) {
   return *this;
 }
 
+json_builder& json_builder::key_raw(string_piece str) {
+  normalize_mode(true);
+  json.push_back('"');
+  json.insert(json.end(), str.str, str.str + str.len);
+  json.push_back('"');
+  json.push_back(':');
+  return *this;
+}
+
 json_builder& json_builder::value(string_piece str, bool append) {
   if (!append || mode != IN_VALUE) {
     normalize_mode(true);
@@ -103,9 +124,38 @@ json_builder& json_builder::value(string_piece str, bool append) {
 }
 
 json_builder& json_builder::value(int number) {
+  return value((long long) number);
+}
+
+json_builder& json_builder::value(unsigned number) {
+  return value((unsigned long long) number);
+}
+
+json_builder& json_builder::value(long number) {
+  return value((long long) number);
+}
+
+json_builder& json_builder::value(unsigned long number) {
+  return value((unsigned long long) number);
+}
+
+json_builder& json_builder::value(long long number) {
   normalize_mode(true);
-  for (auto&& chr : std::to_string(number))
-    json.push_back(chr);
+  encode_integer(number < 0 ? 0ULL - (unsigned long long) number : (unsigned long long) number, number < 0);
+  mode = AFTER_VALUE;
+  return *this;
+}
+
+json_builder& json_builder::value(unsigned long long number) {
+  normalize_mode(true);
+  encode_integer(number, false);
+  mode = AFTER_VALUE;
+  return *this;
+}
+
+json_builder& json_builder::value(double number, int precision) {
+  normalize_mode(true);
+  encode_double(number, precision);
   mode = AFTER_VALUE;
   return *this;
 }
@@ -138,6 +188,13 @@ json_builder& json_builder::value_xml_escape(string_piece str, bool append) {
   return *this;
 }
 
+json_builder& json_builder::value_raw(string_piece str) {
+  normalize_mode(true);
+  json.insert(json.end(), str.str, str.str + str.len);
+  mode = AFTER_VALUE;
+  return *this;
+}
+
 json_builder& json_builder::indent() {
   if (!need_indent) {
     normalize_mode(false);
@@ -167,7 +224,7 @@ json_builder& json_builder::finish(bool indent) {
 }
 
 string_piece json_builder::current() const {
-  return string_piece(json.data(), json.size());
+  return string_piece(json.data() + json_offset, json.size() - json_offset);
 }
 
 json_builder::operator string_piece() const {
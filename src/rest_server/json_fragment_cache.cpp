@@ -0,0 +1,46 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "json_fragment_cache.h"
+
+namespace ufal {
+namespace microrestd {
+
+std::shared_ptr<const std::string> json_fragment_cache::get(const std::string& key, const generator& generate) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = fragments.find(key);
+    if (it != fragments.end()) return it->second;
+  }
+
+  // Generate the fragment without holding the lock; if several threads
+  // generate the same fragment concurrently, the first one is stored.
+  json_builder json;
+  generate(json);
+  json.finish();
+  string_piece generated = json.current();
+  if (generated.len && generated.str[generated.len - 1] == '\n') generated.len--;
+  auto fragment = std::make_shared<const std::string>(generated.str, generated.len);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return fragments.emplace(key, fragment).first->second;
+}
+
+void json_fragment_cache::erase(const std::string& key) {
+  std::lock_guard<std::mutex> lock(mutex);
+  fragments.erase(key);
+}
+
+void json_fragment_cache::clear() {
+  std::lock_guard<std::mutex> lock(mutex);
+  fragments.clear();
+}
+
+} // namespace microrestd
+} // namespace ufal
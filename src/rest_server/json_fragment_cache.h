@@ -0,0 +1,45 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "json_builder.h"
+
+namespace ufal {
+namespace microrestd {
+
+// Serialized JSON values stored under string keys, which can be spliced into
+// responses using json_builder::value_raw without encoding them again.
+// The cache can be shared by all threads of a service.
+class json_fragment_cache {
+ public:
+  typedef std::function<void(json_builder& json)> generator;
+
+  // Return the fragment stored under the given key. If there is none, it is
+  // generated by the given function, which should produce a single JSON value.
+  std::shared_ptr<const std::string> get(const std::string& key, const generator& generate);
+
+  // Remove the fragment stored under the given key, or all fragments. The
+  // fragments already returned by get stay valid.
+  void erase(const std::string& key);
+  void clear();
+
+ private:
+  std::mutex mutex;
+  std::unordered_map<std::string, std::shared_ptr<const std::string>> fragments;
+};
+
+} // namespace microrestd
+} // namespace ufal
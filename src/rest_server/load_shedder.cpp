@@ -0,0 +1,46 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <limits>
+
+#include "load_shedder.h"
+
+namespace ufal {
+namespace microrestd {
+
+void load_shedder::set_target(unsigned target_ms, unsigned interval_ms) {
+  target = std::chrono::milliseconds(target_ms);
+  interval = std::chrono::milliseconds(interval_ms > target_ms ? interval_ms : target_ms);
+
+  interval_end = (clock::now() + interval).time_since_epoch().count();
+  min_delay = std::numeric_limits<clock::rep>::max();
+  overloaded = false;
+}
+
+bool load_shedder::admit(clock::time_point queued) {
+  auto now = clock::now();
+  auto delay = (now - queued).count();
+
+  // Update the minimum delay of the current interval.
+  auto current_min = min_delay.load(std::memory_order_relaxed);
+  while (delay < current_min && !min_delay.compare_exchange_weak(current_min, delay, std::memory_order_relaxed)) {}
+
+  // At the end of the interval, one of the threads evaluates it and starts a new one.
+  auto current_end = interval_end.load(std::memory_order_relaxed);
+  if (now.time_since_epoch().count() >= current_end &&
+      interval_end.compare_exchange_strong(current_end, (now + interval).time_since_epoch().count(), std::memory_order_relaxed)) {
+    auto interval_min = min_delay.exchange(std::numeric_limits<clock::rep>::max(), std::memory_order_relaxed);
+    overloaded.store(interval_min > target.count(), std::memory_order_relaxed);
+  }
+
+  return !overloaded.load(std::memory_order_relaxed) || delay <= target.count();
+}
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,41 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+namespace ufal {
+namespace microrestd {
+
+// CoDel-style admission control. While the minimum queueing delay during
+// the last interval exceeds the target, requests queued for longer than
+// the target are rejected; otherwise all requests are admitted.
+class load_shedder {
+ public:
+  typedef std::chrono::steady_clock clock;
+
+  void set_target(unsigned target_ms, unsigned interval_ms);
+  bool enabled() const { return target.count() > 0; }
+
+  // Record queueing delay of a request, return false if it should be rejected.
+  bool admit(clock::time_point queued);
+
+ private:
+  clock::duration target = clock::duration::zero();
+  clock::duration interval = clock::duration::zero();
+
+  std::atomic<clock::rep> interval_end{0};
+  std::atomic<clock::rep> min_delay{0};
+  std::atomic<bool> overloaded{false};
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,70 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+
+#include "rate_limiter.h"
+
+namespace ufal {
+namespace microrestd {
+
+void rate_limiter::set_limit(double rate, unsigned burst) {
+  this->rate = rate;
+  this->burst = std::max(burst, 1U);
+
+  for (auto&& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.buckets.clear();
+    shard.purge_size = min_purge_size;
+  }
+}
+
+bool rate_limiter::allow(const std::string& client) {
+  if (!enabled()) return true;
+
+  auto& shard = shards[std::hash<std::string>()(client) % shards_size];
+  auto now = clock::now();
+  std::lock_guard<std::mutex> lock(shard.mutex);
+
+  // Drop the buckets which would be full already, as they are
+  // equivalent to missing ones.
+  if (shard.buckets.size() >= shard.purge_size) {
+    for (auto it = shard.buckets.begin(); it != shard.buckets.end(); )
+      if (it->second.tokens + std::chrono::duration<double>(now - it->second.updated).count() * rate >= burst)
+        it = shard.buckets.erase(it);
+      else
+        it++;
+    shard.purge_size = std::max(size_t(min_purge_size), 2 * shard.buckets.size());
+  }
+
+  auto it = shard.buckets.find(client);
+  if (it == shard.buckets.end()) {
+    shard.buckets.emplace(client, bucket{burst - 1, now});
+    return true;
+  }
+
+  auto& bucket = it->second;
+  bucket.tokens = std::min(burst, bucket.tokens + std::chrono::duration<double>(now - bucket.updated).count() * rate);
+  bucket.updated = now;
+  if (bucket.tokens < 1) return false;
+  bucket.tokens -= 1;
+  return true;
+}
+
+size_t rate_limiter::clients() {
+  size_t clients = 0;
+  for (auto&& shard : shards) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    clients += shard.buckets.size();
+  }
+  return clients;
+}
+
+} // namespace microrestd
+} // namespace ufal
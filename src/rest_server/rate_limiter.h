@@ -0,0 +1,55 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace ufal {
+namespace microrestd {
+
+// Token buckets of individual clients, stored in independently locked shards.
+// The buckets are refilled lazily when a client makes a request.
+class rate_limiter {
+ public:
+  void set_limit(double rate, unsigned burst);
+  bool enabled() const { return rate > 0; }
+
+  // Take a token from the bucket of the given client, return false if it is empty.
+  bool allow(const std::string& client);
+
+  // Number of clients whose buckets are currently stored.
+  size_t clients();
+
+ private:
+  typedef std::chrono::steady_clock clock;
+
+  enum { shards_size = 16, min_purge_size = 1024 };
+
+  struct bucket {
+    double tokens;
+    clock::time_point updated;
+  };
+
+  struct shard {
+    std::mutex mutex;
+    std::unordered_map<std::string, bucket> buckets;
+    size_t purge_size = min_purge_size;
+  };
+
+  double rate = 0;
+  double burst = 0;
+  shard shards[shards_size];
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,60 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "request_arena.h"
+
+namespace ufal {
+namespace microrestd {
+
+request_arena::~request_arena() {
+  clear();
+}
+
+void* request_arena::allocate(size_t size, size_t alignment) {
+  char* aligned = (char*) ((uintptr_t(current) + alignment - 1) & ~uintptr_t(alignment - 1));
+  if (aligned < end && size <= size_t(end - aligned)) {
+    current = aligned + size;
+    return aligned;
+  }
+  return allocate_chunk(size, alignment);
+}
+
+void request_arena::clear() {
+  while (chunks) {
+    chunk* next = chunks->next;
+    free(chunks);
+    chunks = next;
+  }
+  current = initial;
+  end = initial + sizeof(initial);
+}
+
+void* request_arena::allocate_chunk(size_t size, size_t alignment) {
+  // Every chunk is at least twice as large as the previous one.
+  size_t chunk_size = 2 * (chunks ? chunks->size : sizeof(initial));
+  size_t header_size = (sizeof(chunk) + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+  if (chunk_size < header_size + size + alignment) chunk_size = header_size + size + alignment;
+
+  chunk* allocated = (chunk*) malloc(chunk_size);
+  if (!allocated) throw std::bad_alloc();
+  allocated->next = chunks;
+  allocated->size = chunk_size;
+  chunks = allocated;
+
+  current = (char*) allocated + header_size;
+  end = (char*) allocated + chunk_size;
+  return allocate(size, alignment);
+}
+
+} // namespace microrestd
+} // namespace ufal
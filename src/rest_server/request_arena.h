@@ -0,0 +1,66 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <cstddef>
+
+namespace ufal {
+namespace microrestd {
+
+// Bump allocator, all memory is released at once when the arena is destroyed
+// or cleared. Not thread-safe.
+class request_arena {
+ public:
+  request_arena() {}
+  ~request_arena();
+
+  request_arena(const request_arena&) = delete;
+  request_arena& operator=(const request_arena&) = delete;
+
+  void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+  void clear();
+
+ private:
+  struct chunk {
+    chunk* next;
+    size_t size;
+  };
+
+  void* allocate_chunk(size_t size, size_t alignment);
+
+  alignas(std::max_align_t) char initial[2048];
+  chunk* chunks = nullptr;
+  char* current = initial;
+  char* end = initial + sizeof(initial);
+};
+
+// STL-compatible allocator using a request_arena.
+template <class T>
+class arena_allocator {
+ public:
+  typedef T value_type;
+  template <class U> struct rebind { typedef arena_allocator<U> other; };
+
+  arena_allocator(request_arena& arena) : arena(&arena) {}
+  template <class U> arena_allocator(const arena_allocator<U>& other) : arena(other.arena) {}
+
+  T* allocate(size_t n) { return (T*) arena->allocate(n * sizeof(T), alignof(T)); }
+  void deallocate(T* /*ptr*/, size_t /*n*/) {}
+
+  template <class U> bool operator==(const arena_allocator<U>& other) const { return arena == other.arena; }
+  template <class U> bool operator!=(const arena_allocator<U>& other) const { return arena != other.arena; }
+
+ private:
+  template <class U> friend class arena_allocator;
+  request_arena* arena;
+};
+
+} // namespace microrestd
+} // namespace ufal
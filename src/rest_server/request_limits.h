@@ -0,0 +1,36 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+
+namespace ufal {
+namespace microrestd {
+
+// Limits of a group of requests overriding the rest_server ones, applied
+// as soon as the request headers are received.
+struct request_limits {
+  // Zero values keep the rest_server limits.
+  unsigned max_request_body_size = 0;
+  unsigned timeout = 0;
+
+  // Maximum number of the requests being handled and responded to
+  // concurrently, zero for unlimited.
+  unsigned max_concurrent_requests = 0;
+
+  // Fraction of the requests logged, negative values keep the rest_server sampling.
+  double log_sampling = -1;
+
+  // Number of the requests being currently handled and responded to.
+  mutable std::atomic<unsigned> concurrent_requests{0};
+};
+
+} // namespace microrestd
+} // namespace ufal
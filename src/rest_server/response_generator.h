@@ -9,6 +9,9 @@
 
 #pragma once
 
+#include <cstdint>
+#include <functional>
+
 #include "string_piece.h"
 
 namespace ufal {
@@ -21,6 +24,19 @@ class response_generator {
   virtual bool generate() = 0;
   virtual string_piece current() const = 0;
   virtual void consume(size_t length) = 0;
+
+  // Optional flushing, send the current data without waiting for min_generated.
+  virtual bool flush() const { return false; }
+
+  // Optional random access, used to serve byte-range requests.
+  virtual bool seekable(uint64_t& /*length*/) const { return false; }
+  virtual bool seek(uint64_t /*offset*/) { return false; }
+
+  // Optional waiting for asynchronously produced data, used when generate()
+  // produced no data. If true is returned, generate() is called again after
+  // resume() is called (from any thread) or after wake_after milliseconds
+  // (if nonzero), without blocking the thread serving the connection.
+  virtual bool wait(const std::function<void()>& /*resume*/, unsigned& /*wake_after*/) { return false; }
 };
 
 } // namespace microrestd
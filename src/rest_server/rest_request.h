@@ -9,17 +9,35 @@
 
 #pragma once
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 
+#include "request_arena.h"
 #include "response_generator.h"
 #include "string_piece.h"
 
 namespace ufal {
 namespace microrestd {
 
+// Monotonic timestamps of the request processing phases,
+// zero (i.e., time_since_epoch() == 0) for phases not reached yet.
+struct request_timing {
+  typedef std::chrono::steady_clock clock;
+
+  clock::time_point connection_accepted;
+  clock::time_point request_received;
+  clock::time_point headers_received;
+  clock::time_point body_received;
+  clock::time_point handle_started;
+  clock::time_point handle_finished;
+  clock::time_point first_byte_generated;
+  clock::time_point last_byte_sent;
+};
+
 class rest_request {
  public:
   virtual ~rest_request() {}
@@ -32,11 +50,28 @@ class rest_request {
   virtual bool respond_method_not_allowed(const char* comma_separated_allowed_methods) = 0;
   virtual bool respond_error(string_piece error, int code = 400) = 0;
 
+  // Memory released when the request is completed. By default,
+  // an arena owned by the request is created on first use.
+  virtual request_arena& arena() {
+    if (!default_arena) default_arena.reset(new request_arena());
+    return *default_arena;
+  }
+
+  // Timestamps of the processing phases reached so far,
+  // by default none.
+  virtual const request_timing& timing() const {
+    static const request_timing no_timing = request_timing();
+    return no_timing;
+  }
+
   std::string url;
   std::string method;
   std::string body;
   std::string content_type;
   std::unordered_map<std::string, std::string> params;
+
+ private:
+  std::unique_ptr<request_arena> default_arena;
 };
 
 } // namespace microrestd
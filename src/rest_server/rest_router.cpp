@@ -0,0 +1,170 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <cstring>
+
+#include "rest_router.h"
+
+namespace ufal {
+namespace microrestd {
+
+static const char* method_names[rest_router::METHODS_SIZE] = {"GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS"};
+
+string_piece rest_router::captures::operator[](const char* name) const {
+  for (unsigned i = 0; i < values_size && names && i < names->size(); i++)
+    if ((*names)[i] == name)
+      return values[i];
+  return string_piece();
+}
+
+bool rest_router::add_route(method_t method, const std::string& route_text, handler route_handler, const request_limits* limits) {
+  if (unsigned(method) >= METHODS_SIZE || route_text.empty() || route_text[0] != '/') return false;
+
+  // Insert the static texts and parameters of the route
+  node* current = &root;
+  std::vector<std::string> names;
+  for (size_t start = 0; start < route_text.size(); ) {
+    if (route_text[start] != '{') {
+      size_t end = route_text.find('{', start);
+      if (end == std::string::npos) end = route_text.size();
+      current = insert(current, string_piece(route_text.data() + start, end - start));
+      start = end;
+    } else {
+      // Parameters span whole segments
+      size_t end = route_text.find('}', start);
+      if (end == std::string::npos || end == start + 1 || route_text[start - 1] != '/' ||
+          (end + 1 < route_text.size() && route_text[end + 1] != '/') ||
+          route_text.find_first_of("{/", start + 1) < end || names.size() >= max_captures)
+        return false;
+      names.emplace_back(route_text, start + 1, end - start - 1);
+      if (!current->parameter) current->parameter.reset(new node());
+      current = current->parameter.get();
+      start = end + 1;
+    }
+  }
+
+  if (current->routes[method] >= 0) return false;
+  current->routes[method] = int(routes.size());
+  routes.push_back({route_handler, names, limits});
+
+  current->allowed_methods.clear();
+  for (int i = 0; i < METHODS_SIZE; i++)
+    if (current->routes[i] >= 0 || (i == METHOD_HEAD && current->routes[METHOD_GET] >= 0))
+      current->allowed_methods.append(current->allowed_methods.empty() ? "" : ", ").append(method_names[i]);
+  return true;
+}
+
+bool rest_router::handle(rest_request& req) {
+  string_piece values[max_captures];
+  unsigned values_size = 0;
+  int route;
+  const node* found = match(req, values, values_size, route);
+  if (!found) return req.respond_not_found();
+  if (route < 0) return req.respond_method_not_allowed(found->allowed_methods.c_str());
+
+  captures route_captures;
+  route_captures.values = values;
+  route_captures.values_size = values_size;
+  route_captures.names = &routes[route].names;
+  return routes[route].route_handler(req, route_captures);
+}
+
+const request_limits* rest_router::limits(const rest_request& req) {
+  string_piece values[max_captures];
+  unsigned values_size = 0;
+  int route;
+  return match(req, values, values_size, route) && route >= 0 ? routes[route].limits : nullptr;
+}
+
+bool rest_router::parse_method(const std::string& method, method_t& parsed) {
+  for (int i = 0; i < METHODS_SIZE; i++)
+    if (method == method_names[i]) {
+      parsed = method_t(i);
+      return true;
+    }
+  return false;
+}
+
+const rest_router::node* rest_router::match(const rest_request& req, string_piece* values, unsigned& values_size, int& route) const {
+  route = -1;
+  const node* found = find(&root, req.url.data(), req.url.data() + req.url.size(), values, values_size);
+  if (!found) return nullptr;
+
+  // Answer HEAD requests by GET handlers, if there is no HEAD handler
+  method_t method;
+  if (parse_method(req.method, method)) {
+    route = found->routes[method];
+    if (route < 0 && method == METHOD_HEAD) route = found->routes[METHOD_GET];
+  }
+  return found;
+}
+
+rest_router::node* rest_router::insert(node* current, string_piece text) {
+  while (text.len) {
+    size_t index = current->indices.find(*text.str);
+    if (index == std::string::npos) {
+      current->indices.push_back(*text.str);
+      current->children.emplace_back(new node());
+      current->children.back()->prefix.assign(text.str, text.len);
+      return current->children.back().get();
+    }
+
+    // Split the child if it shares only a part of its prefix with the text
+    auto& child = current->children[index];
+    size_t common = 0;
+    while (common < text.len && common < child->prefix.size() && child->prefix[common] == text.str[common]) common++;
+    if (common < child->prefix.size()) {
+      std::unique_ptr<node> split(new node());
+      split->prefix.assign(child->prefix, 0, common);
+      child->prefix.erase(0, common);
+      split->indices.push_back(child->prefix[0]);
+      split->children.push_back(std::move(child));
+      child = std::move(split);
+    }
+
+    current = child.get();
+    text.str += common;
+    text.len -= common;
+  }
+  return current;
+}
+
+const rest_router::node* rest_router::find(const node* current, const char* path, const char* end, string_piece* values, unsigned& values_size) {
+  if (path == end) return current->allowed_methods.empty() ? nullptr : current;
+
+  // Try the static child first
+  size_t index = current->indices.find(*path);
+  if (index != std::string::npos) {
+    const node* child = current->children[index].get();
+    size_t common = 0, length = std::min(size_t(end - path), child->prefix.size());
+    while (common < length && child->prefix[common] == path[common]) common++;
+    if (common == child->prefix.size())
+      if (const node* found = find(child, path + common, end, values, values_size))
+        return found;
+  }
+
+  // Then a parameter spanning the current segment. Static texts have fixed
+  // lengths and parameters span whole segments, so every node can be reached
+  // only at a single position of the url and is therefore tried at most once.
+  if (current->parameter && *path != '/') {
+    const char* segment_end = (const char*) memchr(path, '/', end - path);
+    if (!segment_end) segment_end = end;
+
+    values[values_size++] = string_piece(path, segment_end - path);
+    if (const node* found = find(current->parameter.get(), segment_end, end, values, values_size))
+      return found;
+    values_size--;
+  }
+
+  return nullptr;
+}
+
+} // namespace microrestd
+} // namespace ufal
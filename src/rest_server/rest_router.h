@@ -0,0 +1,82 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "rest_service.h"
+#include "string_piece.h"
+
+namespace ufal {
+namespace microrestd {
+
+// Service dispatching requests to handlers of routes like /models/{name}/process.
+// The routes are stored in a radix tree and matched without allocating memory.
+// Parameters span whole path segments; static segments take precedence over
+// parameters, which are tried when the rest of the url does not match. Every
+// tree node is tried at most once, so backtracking is bounded by the tree size.
+class rest_router : public rest_service {
+ public:
+  enum method_t { METHOD_GET, METHOD_HEAD, METHOD_POST, METHOD_PUT, METHOD_DELETE, METHOD_PATCH, METHOD_OPTIONS, METHODS_SIZE };
+
+  class captures {
+   public:
+    unsigned size() const { return values_size; }
+    string_piece operator[](unsigned index) const { return index < values_size ? values[index] : string_piece(); }
+    string_piece operator[](const char* name) const;
+
+   private:
+    friend class rest_router;
+    const string_piece* values = nullptr;
+    unsigned values_size = 0;
+    const std::vector<std::string>* names = nullptr;
+  };
+
+  typedef std::function<bool(rest_request& req, const captures& captures)> handler;
+
+  // Return false if the route is invalid or already has a handler for the method.
+  bool add_route(method_t method, const std::string& route, handler route_handler, const request_limits* limits = nullptr);
+
+  virtual bool handle(rest_request& req) override;
+  virtual const request_limits* limits(const rest_request& req) override;
+
+  static bool parse_method(const std::string& method, method_t& parsed);
+
+ private:
+  enum { max_captures = 16 };
+
+  struct route {
+    handler route_handler;
+    std::vector<std::string> names;
+    const request_limits* limits;
+  };
+
+  struct node {
+    std::string prefix;
+    std::string indices;
+    std::vector<std::unique_ptr<node>> children;
+    std::unique_ptr<node> parameter;
+    int routes[METHODS_SIZE] = {-1, -1, -1, -1, -1, -1, -1};
+    std::string allowed_methods;
+  };
+
+  const node* match(const rest_request& req, string_piece* values, unsigned& values_size, int& route) const;
+  static node* insert(node* current, string_piece text);
+  static const node* find(const node* current, const char* path, const char* end, string_piece* values, unsigned& values_size);
+
+  node root;
+  std::vector<route> routes;
+};
+
+} // namespace microrestd
+} // namespace ufal
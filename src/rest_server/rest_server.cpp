@@ -8,27 +8,35 @@
 // file, You can obtain one at http://mozilla.org/MPL/2.0/.
 
 #include <chrono>
+#include <cstring>
 #include <ctime>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <memory>
+#include <random>
+#include <sstream>
 #include <thread>
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
-#include <condition_variable>
-#include <mutex>
 #include <ws2tcpip.h>
 #include <windows.h>
 #define MHD_socket_close(fd) closesocket((fd))
 #else
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <netdb.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <unistd.h>
 #define MHD_socket_close(fd) close((fd))
 #endif
 
+#include "http_helpers.h"
+#include "json_builder.h"
 #include "response_generator.h"
 #include "rest_server.h"
 #include "../libmicrohttpd/microhttpd.h"
@@ -53,18 +61,58 @@ class MHD_PostProcessorDeleter {
   }
 };
 
+// State shared by a request waiting for its generator and the producer of the data.
+class generator_waiter {
+ public:
+  void resume() {
+    {
+      lock_guard<mutex> lock(waiter_mutex);
+      resumed = true;
+      if (connection) MHD_wake_up_connection(connection);
+    }
+    resumed_cv.notify_all();
+  }
+
+  mutex waiter_mutex;
+  condition_variable resumed_cv;
+  bool resumed = false;
+  MHD_Connection* connection = nullptr;
+  wake_up_timer::handle timer;
+};
+
 // Class rest_server::microhttpd_request
 class rest_server::microhttpd_request : public rest_request {
  public:
   static bool initialize();
 
   microhttpd_request(const rest_server& server, MHD_Connection* connection, const char* url, const char* content_type, const char* method);
+  ~microhttpd_request();
+
+  static MHD_Response* too_large() { return response_too_large.get(); }
+  static MHD_Response* too_many_requests() { return response_too_many_requests.get(); }
+  static MHD_Response* service_unavailable() { return response_service_unavailable.get(); }
+  static MHD_Response* create_metrics_response(const string& metrics, bool keep_alive) { return create_response(metrics, "text/plain; version=0.0.4", keep_alive); }
+
+  // Whether the request is counted as queued in the server metrics.
+  bool queued = false;
+
+  // Timestamps of the processing phases.
+  request_timing phase_times;
+
+  // Limits of the request given by the service, and whether to log the
+  // request when completed instead of when received.
+  const request_limits* limits = nullptr;
+  bool log_on_completion = false;
+
+  void apply_limits(const request_limits* limits);
+  bool declared_body_too_large() const;
 
   int handle(rest_service* service);
   bool process_request_body(const char* request_body, size_t request_body_len);
 
   const sockaddr* address() const;
   const char* forwarded_for() const;
+  request_timing::clock::time_point data_received() const;
 
   virtual bool respond(const char* content_type, string_piece body,
                        const std::vector<std::pair<const char*, const char*>>& headers = {}) override;
@@ -73,46 +121,72 @@ class rest_server::microhttpd_request : public rest_request {
   virtual bool respond_not_found() override;
   virtual bool respond_method_not_allowed(const char* comma_separated_allowed_methods) override;
   virtual bool respond_error(string_piece error, int code = 400) override;
+  virtual request_arena& arena() override;
+  virtual const request_timing& timing() const override;
 
  private:
   const rest_server& server;
   MHD_Connection* connection;
 
+  // Declared before the generator, which may use the arena memory.
+  request_arena memory;
+
   unique_ptr<MHD_PostProcessor, MHD_PostProcessorDeleter> post_processor;
   bool need_post_processor;
   bool unsupported_multipart_encoding;
+  unsigned max_request_body_size;
   unsigned remaining_request_body_size;
+  bool concurrent_request_counted = false;
 
   unique_ptr<response_generator> generator;
   bool generator_end;
   unsigned generator_offset;
+  uint64_t generator_start;
+  uint64_t generator_position;
+  shared_ptr<generator_waiter> waiter;
+  function<void()> resume_generator;
 
-  static MHD_Response* create_response(string_piece data, const char* content_type,
+  const function<void()>& generator_resume_callback();
+  bool wait_for_generator(unsigned wake_after);
+
+  bool add_server_timing(MHD_Response* response) const;
+  static request_timing::clock::time_point monotonic_time(const MHD_ConnectionInfo* info, uint64_t MHD_ConnectionInfo::*field);
+
+  int byte_range(uint64_t length, const std::vector<std::pair<const char*, const char*>>& headers, uint64_t& start, uint64_t& size) const;
+
+  static MHD_Response* create_response(string_piece data, const char* content_type, bool keep_alive,
                                        const std::vector<std::pair<const char*, const char*>>& headers = {});
-  static MHD_Response* create_generator_response(microhttpd_request* request, const char* content_type,
+  static MHD_Response* create_generator_response(microhttpd_request* request, uint64_t size, const char* content_type,
                                                  const std::vector<std::pair<const char*, const char*>>& headers = {});
   static MHD_Response* create_plain_permanent_response(const string& data);
-  static void response_headers(unique_ptr<MHD_Response, MHD_ResponseDeleter>& response, const char* content_type,
+  static void response_headers(unique_ptr<MHD_Response, MHD_ResponseDeleter>& response, const char* content_type, bool keep_alive,
                                const std::vector<std::pair<const char*, const char*>>& headers = {});
 
   static int get_iterator(void* cls, MHD_ValueKind kind, const char* key, const char* value);
   static int post_iterator(void* cls, MHD_ValueKind kind, const char* key, const char* filename, const char* content_type, const char* transfer_encoding, const char* data, uint64_t off, size_t size);
   static ssize_t generator_callback(void* cls, uint64_t pos, char* buf, size_t max);
 
-  static bool valid_utf8(const string& text);
+  static bool parse_byte_range(const char* range, uint64_t length, uint64_t& start, uint64_t& size, bool& satisfiable);
 
-  static bool http_value_compare(const char* string, const char* pattern);
-
-  static unique_ptr<MHD_Response, MHD_ResponseDeleter> response_not_allowed, response_not_found, response_too_large, response_unsupported_multipart_encoding, response_invalid_utf8;
+  static unique_ptr<MHD_Response, MHD_ResponseDeleter> response_not_allowed, response_not_found, response_too_large, response_too_many_requests, response_service_unavailable, response_unsupported_multipart_encoding, response_invalid_utf8;
 };
 unique_ptr<MHD_Response, MHD_ResponseDeleter> rest_server::microhttpd_request::response_not_allowed,
                                               rest_server::microhttpd_request::response_not_found,
                                               rest_server::microhttpd_request::response_too_large,
+                                              rest_server::microhttpd_request::response_too_many_requests,
+                                              rest_server::microhttpd_request::response_service_unavailable,
                                               rest_server::microhttpd_request::response_unsupported_multipart_encoding,
                                               rest_server::microhttpd_request::response_invalid_utf8;
 
 rest_server::microhttpd_request::microhttpd_request(const rest_server& server, MHD_Connection* connection, const char* url, const char* content_type, const char* method)
-  : server(server), connection(connection), unsupported_multipart_encoding(false), remaining_request_body_size(server.max_request_body_size + 1) {
+  : server(server), connection(connection), unsupported_multipart_encoding(false),
+    max_request_body_size(server.max_request_body_size), remaining_request_body_size(server.max_request_body_size + 1) {
+  // Initialize the timestamps of the phases until now
+  phase_times.headers_received = request_timing::clock::now();
+  phase_times.connection_accepted = monotonic_time(MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CONNECTION_ACCEPTED), &MHD_ConnectionInfo::connection_accepted);
+  phase_times.request_received = monotonic_time(MHD_get_connection_info(connection, MHD_CONNECTION_INFO_REQUEST_RECEIVED), &MHD_ConnectionInfo::request_received);
+  if (phase_times.request_received.time_since_epoch().count() == 0) phase_times.request_received = phase_times.headers_received;
+
   // Initialize rest_request fields
   this->url = url;
   this->method = method;
@@ -120,8 +194,8 @@ rest_server::microhttpd_request::microhttpd_request(const rest_server& server, M
 
   // Create post processor if needed
   need_post_processor = this->method == MHD_HTTP_METHOD_POST &&
-      (http_value_compare(content_type, MHD_HTTP_POST_ENCODING_FORM_URLENCODED) ||
-       http_value_compare(content_type, MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA));
+      (http_helpers::http_value_compare(content_type, MHD_HTTP_POST_ENCODING_FORM_URLENCODED) ||
+       http_helpers::http_value_compare(content_type, MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA));
   if (need_post_processor) {
     post_processor.reset(MHD_create_post_processor(connection, 32 << 10, &post_iterator, this));
     if (!post_processor) cerr << "Cannot allocate new post processor!" << endl;
@@ -131,10 +205,44 @@ rest_server::microhttpd_request::microhttpd_request(const rest_server& server, M
   MHD_get_connection_values(connection, MHD_GET_ARGUMENT_KIND, get_iterator, this);
 }
 
+rest_server::microhttpd_request::~microhttpd_request() {
+  if (waiter) {
+    {
+      lock_guard<mutex> lock(waiter->waiter_mutex);
+      waiter->connection = nullptr;
+    }
+    server.generator_timer.cancel(waiter->timer);
+  }
+  if (concurrent_request_counted) limits->concurrent_requests.fetch_sub(1, std::memory_order_relaxed);
+  if (limits && limits->timeout && limits->timeout != server.timeout)
+    MHD_set_connection_option(connection, MHD_CONNECTION_OPTION_TIMEOUT, server.timeout);
+}
+
+void rest_server::microhttpd_request::apply_limits(const request_limits* limits) {
+  this->limits = limits;
+  if (!limits) return;
+
+  if (limits->max_request_body_size) {
+    max_request_body_size = limits->max_request_body_size;
+    remaining_request_body_size = max_request_body_size + 1;
+  }
+  if (limits->timeout && limits->timeout != server.timeout)
+    MHD_set_connection_option(connection, MHD_CONNECTION_OPTION_TIMEOUT, limits->timeout);
+}
+
+bool rest_server::microhttpd_request::declared_body_too_large() const {
+  if (!max_request_body_size) return false;
+
+  const char* content_length = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_CONTENT_LENGTH);
+  return content_length && strtoull(content_length, nullptr, 10) > max_request_body_size;
+}
+
 bool rest_server::microhttpd_request::initialize() {
   static string not_allowed = "Requested method is not allowed.\n";
   static string not_found = "Requested URL was not found.\n";
   static string too_large = "Request was too large.\n";
+  static string too_many_requests = "Too many requests, try again later.\n";
+  static string service_unavailable = "The server is overloaded, try again later.\n";
   static string unsupported_multipart_encoding = "Unsupported transfer-encoding of multipart/form-data POST request part. Currently only 7bit, 8bit or binary is supported.\n";
   static string invalid_utf8 = "The request arguments are not valid UTF-8.\n";
 
@@ -148,6 +256,12 @@ bool rest_server::microhttpd_request::initialize() {
   response_too_large.reset(create_plain_permanent_response(too_large));
   if (!response_too_large) return false;
 
+  response_too_many_requests.reset(create_plain_permanent_response(too_many_requests));
+  if (!response_too_many_requests) return false;
+
+  response_service_unavailable.reset(create_plain_permanent_response(service_unavailable));
+  if (!response_service_unavailable) return false;
+
   response_unsupported_multipart_encoding.reset(create_plain_permanent_response(unsupported_multipart_encoding));
   if (!response_unsupported_multipart_encoding) return false;
 
@@ -170,27 +284,39 @@ int rest_server::microhttpd_request::handle(rest_service* service) {
     return MHD_queue_response(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE, response_unsupported_multipart_encoding.get());
 
   // Was the request too large?
-  if (server.max_request_body_size && !remaining_request_body_size)
+  if (max_request_body_size && !remaining_request_body_size)
     return MHD_queue_response(connection, MHD_HTTP_REQUEST_ENTITY_TOO_LARGE, response_too_large.get());
 
   // Are all arguments legal utf-8?
   for (auto&& param : params)
-    if (!valid_utf8(param.first) || !valid_utf8(param.second))
+    if (!http_helpers::valid_utf8(param.first) || !http_helpers::valid_utf8(param.second))
       return MHD_queue_response(connection, MHD_HTTP_UNSUPPORTED_MEDIA_TYPE, response_invalid_utf8.get());
 
+  // Is the limit of concurrently handled requests reached?
+  if (limits && limits->max_concurrent_requests) {
+    if (limits->concurrent_requests.fetch_add(1, std::memory_order_relaxed) >= limits->max_concurrent_requests) {
+      limits->concurrent_requests.fetch_sub(1, std::memory_order_relaxed);
+      return MHD_queue_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, response_service_unavailable.get());
+    }
+    concurrent_request_counted = true;
+  }
+
   // Let the service handle the request and respond with one of the respond_* methods.
-  return service->handle(*this) ? MHD_YES : MHD_NO;
+  phase_times.handle_started = request_timing::clock::now();
+  bool handled = service->handle(*this);
+  phase_times.handle_finished = request_timing::clock::now();
+  return handled ? MHD_YES : MHD_NO;
 }
 
 bool rest_server::microhttpd_request::process_request_body(const char* request_body, size_t request_body_len) {
-  if (!server.max_request_body_size || remaining_request_body_size > request_body_len) {
+  if (!max_request_body_size || remaining_request_body_size > request_body_len) {
     if (need_post_processor) {
       if (!post_processor || MHD_post_process(post_processor.get(), request_body, request_body_len) != MHD_YES)
         return false;
     } else {
       body.append(request_body, request_body_len);
     }
-    if (server.max_request_body_size) remaining_request_body_size -= request_body_len;
+    if (max_request_body_size) remaining_request_body_size -= request_body_len;
   } else {
     remaining_request_body_size = 0;
   }
@@ -202,14 +328,26 @@ const sockaddr* rest_server::microhttpd_request::address() const {
   return info ? info->client_addr : nullptr;
 }
 
+request_timing::clock::time_point rest_server::microhttpd_request::monotonic_time(const MHD_ConnectionInfo* info, uint64_t MHD_ConnectionInfo::*field) {
+  if (!info) return request_timing::clock::time_point();
+  return request_timing::clock::time_point(chrono::duration_cast<request_timing::clock::duration>(chrono::nanoseconds(info->*field)));
+}
+
+request_timing::clock::time_point rest_server::microhttpd_request::data_received() const {
+  // When the last data of the request were found ready to be read, i.e., when
+  // the event loop returned with them, which starts their queueing delay.
+  auto received = monotonic_time(MHD_get_connection_info(connection, MHD_CONNECTION_INFO_DATA_RECEIVED), &MHD_ConnectionInfo::data_received);
+  return received.time_since_epoch().count() ? received : phase_times.headers_received;
+}
+
 const char* rest_server::microhttpd_request::forwarded_for() const {
   return MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Forwarded-For");
 }
 
 bool rest_server::microhttpd_request::respond(const char* content_type, string_piece body,
                                               const std::vector<std::pair<const char*, const char*>>& headers) {
-  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response(body, content_type, headers));
-  if (!response) return false;
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response(body, content_type, server.keep_alive && !server.stopping, headers));
+  if (!response || !add_server_timing(response.get())) return false;
   return MHD_queue_response(connection, MHD_HTTP_OK, response.get()) == MHD_YES;
 }
 
@@ -218,9 +356,41 @@ bool rest_server::microhttpd_request::respond(const char* content_type, response
   this->generator.reset(generator);
   this->generator_end = false;
   this->generator_offset = 0;
-  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_generator_response(this, content_type, headers));
-  if (!response) return false;
-  return MHD_queue_response(connection, MHD_HTTP_OK, response.get()) == MHD_YES;
+  this->generator_start = 0;
+  this->generator_position = 0;
+
+  // Generators of unknown length are streamed as they are generated.
+  uint64_t length;
+  if (!generator->seekable(length)) {
+    unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_generator_response(this, MHD_SIZE_UNKNOWN, content_type, headers));
+    if (!response || !add_server_timing(response.get())) return false;
+    return MHD_queue_response(connection, MHD_HTTP_OK, response.get()) == MHD_YES;
+  }
+
+  // Seekable generators can serve a byte range of the response.
+  uint64_t start, size;
+  int code = byte_range(length, headers, start, size);
+  char content_range[2 * 20/*64-bit number*/ + 20/*bytes -/*/ + 1/*\0*/];
+  if (code == MHD_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE) {
+    this->generator.reset();
+    snprintf(content_range, sizeof(content_range), "bytes */%llu", (unsigned long long) length);
+    unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response("Requested range not satisfiable.\n", "text/plain", server.keep_alive && !server.stopping));
+    if (!response) return false;
+    if (MHD_add_response_header(response.get(), MHD_HTTP_HEADER_CONTENT_RANGE, content_range) != MHD_YES) return response.reset(), false;
+    return MHD_queue_response(connection, code, response.get()) == MHD_YES;
+  }
+
+  if (!generator->seek(start)) return false;
+  this->generator_start = this->generator_position = start;
+
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_generator_response(this, size, content_type, headers));
+  if (!response || !add_server_timing(response.get())) return false;
+  if (MHD_add_response_header(response.get(), MHD_HTTP_HEADER_ACCEPT_RANGES, "bytes") != MHD_YES) return response.reset(), false;
+  if (code == MHD_HTTP_PARTIAL_CONTENT) {
+    snprintf(content_range, sizeof(content_range), "bytes %llu-%llu/%llu", (unsigned long long) start, (unsigned long long) (start + size - 1), (unsigned long long) length);
+    if (MHD_add_response_header(response.get(), MHD_HTTP_HEADER_CONTENT_RANGE, content_range) != MHD_YES) return response.reset(), false;
+  }
+  return MHD_queue_response(connection, code, response.get()) == MHD_YES;
 }
 
 bool rest_server::microhttpd_request::respond_not_found() {
@@ -228,44 +398,93 @@ bool rest_server::microhttpd_request::respond_not_found() {
 }
 
 bool rest_server::microhttpd_request::respond_method_not_allowed(const char* comma_separated_allowed_methods) {
-  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response("Requested method is not allowed.\n", "text/plain"));
-  if (!response) return false;
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response("Requested method is not allowed.\n", "text/plain", server.keep_alive && !server.stopping));
+  if (!response || !add_server_timing(response.get())) return false;
   if (MHD_add_response_header(response.get(), MHD_HTTP_HEADER_ALLOW, comma_separated_allowed_methods) != MHD_YES) return response.reset(), false;
   return MHD_queue_response(connection, MHD_HTTP_METHOD_NOT_ALLOWED, response.get()) == MHD_YES;
 }
 
 bool rest_server::microhttpd_request::respond_error(string_piece error, int code) {
-  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response(error, "text/plain"));
-  if (!response) return false;
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(create_response(error, "text/plain", server.keep_alive && !server.stopping));
+  if (!response || !add_server_timing(response.get())) return false;
   return MHD_queue_response(connection, code, response.get()) == MHD_YES;
 }
 
+request_arena& rest_server::microhttpd_request::arena() {
+  return memory;
+}
+
+const request_timing& rest_server::microhttpd_request::timing() const {
+  return phase_times;
+}
+
+bool rest_server::microhttpd_request::add_server_timing(MHD_Response* response) const {
+  if (!server.server_timing_header) return true;
+
+  // The response is being created by the service, so the handle phase lasts until now.
+  auto now = request_timing::clock::now();
+  auto ms = [](request_timing::clock::duration duration) { return chrono::duration<double, milli>(duration).count(); };
+  char server_timing[3 * (6/*name*/ + 5/*;dur=*/ + 20/*number*/ + 2/*, */) + 1/*\0*/];
+  snprintf(server_timing, sizeof(server_timing), "wait;dur=%.3f, upload;dur=%.3f, handle;dur=%.3f",
+           ms(phase_times.headers_received - phase_times.request_received),
+           ms(phase_times.body_received - phase_times.headers_received),
+           ms(now - phase_times.handle_started));
+  return MHD_add_response_header(response, "Server-Timing", server_timing) == MHD_YES;
+}
+
+int rest_server::microhttpd_request::byte_range(uint64_t length, const std::vector<std::pair<const char*, const char*>>& headers, uint64_t& start, uint64_t& size) const {
+  start = 0;
+  size = length;
+
+  // Ranges are used only for GET and HEAD requests.
+  if (method != MHD_HTTP_METHOD_GET && method != MHD_HTTP_METHOD_HEAD) return MHD_HTTP_OK;
+
+  const char* range = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_RANGE);
+  if (!range) return MHD_HTTP_OK;
+
+  // With If-Range, the range is used only if the given validator matches
+  // the ETag or Last-Modified header of the response.
+  const char* if_range = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_IF_RANGE);
+  if (if_range) {
+    bool matches = false;
+    for (auto&& header : headers)
+      if ((http_helpers::http_value_compare(header.first, MHD_HTTP_HEADER_ETAG) && strncmp(header.second, "W/", 2) != 0) ||
+          http_helpers::http_value_compare(header.first, MHD_HTTP_HEADER_LAST_MODIFIED))
+        matches = matches || strcmp(header.second, if_range) == 0;
+    if (!matches) return MHD_HTTP_OK;
+  }
+
+  bool satisfiable;
+  if (!parse_byte_range(range, length, start, size, satisfiable)) return start = 0, size = length, MHD_HTTP_OK;
+  return satisfiable ? MHD_HTTP_PARTIAL_CONTENT : MHD_HTTP_REQUESTED_RANGE_NOT_SATISFIABLE;
+}
+
 MHD_Response* rest_server::microhttpd_request::create_plain_permanent_response(const string& data) {
   unique_ptr<MHD_Response, MHD_ResponseDeleter> response(MHD_create_response_from_buffer(data.size(), (void*) data.c_str(), MHD_RESPMEM_PERSISTENT));
-  response_headers(response, "text/plain");
+  response_headers(response, "text/plain", false);
   return response.release();
 }
 
-MHD_Response* rest_server::microhttpd_request::create_response(string_piece data, const char* content_type,
+MHD_Response* rest_server::microhttpd_request::create_response(string_piece data, const char* content_type, bool keep_alive,
                                                                const std::vector<std::pair<const char*, const char*>>& headers) {
   unique_ptr<MHD_Response, MHD_ResponseDeleter> response(MHD_create_response_from_buffer(data.len, (void*) data.str, MHD_RESPMEM_MUST_COPY));
-  response_headers(response, content_type, headers);
+  response_headers(response, content_type, keep_alive, headers);
   return response.release();
 }
 
-MHD_Response* rest_server::microhttpd_request::create_generator_response(microhttpd_request* request, const char* content_type,
+MHD_Response* rest_server::microhttpd_request::create_generator_response(microhttpd_request* request, uint64_t size, const char* content_type,
                                                                          const std::vector<std::pair<const char*, const char*>>& headers) {
-  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(MHD_create_response_from_callback(-1, 32 << 10, generator_callback, request, nullptr));
-  response_headers(response, content_type, headers);
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(MHD_create_response_from_callback(size, 32 << 10, generator_callback, request, nullptr));
+  response_headers(response, content_type, request->server.keep_alive && !request->server.stopping, headers);
   return response.release();
 }
 
-void rest_server::microhttpd_request::response_headers(unique_ptr<MHD_Response, MHD_ResponseDeleter>& response, const char* content_type,
+void rest_server::microhttpd_request::response_headers(unique_ptr<MHD_Response, MHD_ResponseDeleter>& response, const char* content_type, bool keep_alive,
                                                        const std::vector<std::pair<const char*, const char*>>& headers) {
   if (!response) return;
   if (MHD_add_response_header(response.get(), MHD_HTTP_HEADER_CONTENT_TYPE, content_type) != MHD_YES ||
       MHD_add_response_header(response.get(), MHD_HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN, "*") != MHD_YES ||
-      MHD_add_response_header(response.get(), MHD_HTTP_HEADER_CONNECTION, "close") != MHD_YES) {
+      (!keep_alive && MHD_add_response_header(response.get(), MHD_HTTP_HEADER_CONNECTION, "close") != MHD_YES)) {
     response.reset();
     return;
   }
@@ -289,9 +508,9 @@ int rest_server::microhttpd_request::post_iterator(void* cls, MHD_ValueKind kind
   auto self = (microhttpd_request*) cls;
   if (kind == MHD_POSTDATA_KIND && key && !self->unsupported_multipart_encoding) {
     // Check that transfer_encoding is supported
-    if (transfer_encoding && !(http_value_compare(transfer_encoding, "binary") ||
-                               http_value_compare(transfer_encoding, "7bit") ||
-                               http_value_compare(transfer_encoding, "8bit"))) {
+    if (transfer_encoding && !(http_helpers::http_value_compare(transfer_encoding, "binary") ||
+                               http_helpers::http_value_compare(transfer_encoding, "7bit") ||
+                               http_helpers::http_value_compare(transfer_encoding, "8bit"))) {
       self->unsupported_multipart_encoding = true;
     } else {
       string& value = self->params[key];
@@ -303,22 +522,45 @@ int rest_server::microhttpd_request::post_iterator(void* cls, MHD_ValueKind kind
   return MHD_YES;
 }
 
-ssize_t rest_server::microhttpd_request::generator_callback(void* cls, uint64_t /*pos*/, char* buf, size_t max) {
+ssize_t rest_server::microhttpd_request::generator_callback(void* cls, uint64_t pos, char* buf, size_t max) {
   auto request = (microhttpd_request*) cls;
+
+  // Seek the generator if the data are requested from a different position.
+  if (request->generator_start + pos != request->generator_position) {
+    if (!request->generator->seek(request->generator_start + pos)) return MHD_CONTENT_READER_END_WITH_ERROR;
+    request->generator_position = request->generator_start + pos;
+    request->generator_end = false;
+    request->generator_offset = 0;
+  }
+
   string_piece data = request->generator->current();
   unsigned minimum = request->server.min_generated < max ? request->server.min_generated : max;
   while (data.len - request->generator_offset < minimum && !request->generator_end) {
+    size_t generated = data.len;
     request->generator_end = !request->generator->generate();
     data = request->generator->current();
+    if (data.len > request->generator_offset && request->generator->flush()) break;
+
+    // Wait for asynchronously produced data if the generator asks to.
+    unsigned wake_after = 0;
+    if (data.len == generated && !request->generator_end &&
+        request->generator->wait(request->generator_resume_callback(), wake_after)) {
+      if (request->server.stopping) { request->generator_end = true; break; }
+      if (data.len > request->generator_offset) break;
+      if (!request->wait_for_generator(wake_after)) return 0;
+    }
   }
 
   // End of data?
   if (data.len <= request->generator_offset) return MHD_CONTENT_READER_END_OF_STREAM;
+  if (request->phase_times.first_byte_generated.time_since_epoch().count() == 0)
+    request->phase_times.first_byte_generated = request_timing::clock::now();
 
   // Copy generated data and remove them from the generator
   size_t data_len = min(data.len - request->generator_offset, max);
   memcpy(buf, data.str + request->generator_offset, data_len);
   request->generator_offset += data_len;
+  request->generator_position += data_len;
   if (data.len - request->generator_offset < minimum) {
     request->generator->consume(request->generator_offset);
     request->generator_offset = 0;
@@ -326,41 +568,92 @@ ssize_t rest_server::microhttpd_request::generator_callback(void* cls, uint64_t
   return data_len;
 }
 
-bool rest_server::microhttpd_request::valid_utf8(const string& text) {
-  for (auto str = (const unsigned char*) text.c_str(); *str; str++)
-    if (*str >= 0x80) {
-      if (*str < 0xC0) return false;
-      else if (*str < 0xE0) {
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-      } else if (*str < 0xF0) {
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-      } else if (*str < 0xF8) {
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-        str++; if (*str < 0x80 || *str >= 0xC0) return false;
-      } else return false;
-    }
+const function<void()>& rest_server::microhttpd_request::generator_resume_callback() {
+  if (!waiter) {
+    waiter = make_shared<generator_waiter>();
+    auto waiter = this->waiter;
+    resume_generator = [waiter]{ waiter->resume(); };
+  }
 
-  return true;
+  // The connection must be known before the generator can call the callback,
+  // otherwise a resume arriving before wait_for_generator would be lost.
+  lock_guard<mutex> lock(waiter->waiter_mutex);
+  waiter->resumed = false;
+  if (server.threads) waiter->connection = connection;
+  return resume_generator;
 }
 
-bool rest_server::microhttpd_request::http_value_compare(const char* string, const char* pattern) {
-  // While there are pattern characters.
-  while (*pattern) {
-    // Skip spaces.
-    while (*string && isspace(*string)) string++;
-    if (!*string) return false;
+bool rest_server::microhttpd_request::wait_for_generator(unsigned wake_after) {
+  auto when = wake_after ? wake_up_timer::clock::now() + chrono::milliseconds(wake_after) : wake_up_timer::clock::time_point::max();
 
-    // Match the next character ignoring case.
-    if (tolower(*string++) != tolower(*pattern++)) return false;
+  // With a thread pool, the connection is woken up by the resume callback or
+  // by the timer, and in the meantime the worker serves other connections.
+  // If the generator was resumed in the meantime, keep generating.
+  if (server.threads) {
+    {
+      lock_guard<mutex> lock(waiter->waiter_mutex);
+      if (waiter->resumed) return true;
+    }
+    server.generator_timer.cancel(waiter->timer);
+    waiter->timer = server.generator_timer.schedule(when, resume_generator);
+    return false;
   }
 
-  // Skip final spaces.
-  while (*string && isspace(*string)) string++;
+  // With a thread per connection, wait in the thread of the connection.
+  waiter->timer = server.generator_timer.schedule(when, resume_generator);
+  {
+    unique_lock<mutex> lock(waiter->waiter_mutex);
+    waiter->resumed_cv.wait(lock, [this]{ return waiter->resumed; });
+  }
+  server.generator_timer.cancel(waiter->timer);
+  return true;
+}
 
-  // Succeed if there are no characters in string left or if there is a semicolon.
-  return !*string || *string == ';';
+bool rest_server::microhttpd_request::parse_byte_range(const char* range, uint64_t length, uint64_t& start, uint64_t& size, bool& satisfiable) {
+  struct parse_helper {
+    static void skip_spaces(const char*& str) { while (*str && isspace((unsigned char) *str)) str++; }
+    static bool number(const char*& str, uint64_t& value) {
+      if (!(*str >= '0' && *str <= '9')) return false;
+      for (value = 0; *str >= '0' && *str <= '9'; str++) {
+        if (value > (uint64_t(-1) - (*str - '0')) / 10) return false;
+        value = value * 10 + (*str - '0');
+      }
+      return true;
+    }
+  };
+
+  // Only a single range in the form of bytes=first-[last] or bytes=-suffix
+  // is supported. Other values are ignored and the whole response is used.
+  parse_helper::skip_spaces(range);
+  for (const char* unit = "bytes"; *unit; unit++, range++)
+    if (tolower((unsigned char) *range) != *unit) return false;
+  parse_helper::skip_spaces(range);
+  if (*range++ != '=') return false;
+  parse_helper::skip_spaces(range);
+
+  uint64_t first, last;
+  if (*range == '-') {
+    range++;
+    if (!parse_helper::number(range, last)) return false;
+    satisfiable = last && length;
+    if (last > length) last = length;
+    start = length - last;
+    size = last;
+  } else {
+    if (!parse_helper::number(range, first)) return false;
+    parse_helper::skip_spaces(range);
+    if (*range++ != '-') return false;
+    parse_helper::skip_spaces(range);
+    last = uint64_t(-1);
+    if (*range && !parse_helper::number(range, last)) return false;
+    if (last < first) return false;
+    satisfiable = first < length;
+    if (last >= length) last = length - 1;
+    start = first;
+    size = satisfiable ? last - first + 1 : 0;
+  }
+  parse_helper::skip_spaces(range);
+  return !*range;
 }
 
 
@@ -371,19 +664,169 @@ void rest_server::set_log_file(ostream* log_file, unsigned max_log_size) {
   this->log_file = log_file;
   this->max_log_size = max_log_size;
 }
+void rest_server::set_async_log(unsigned queue_size) { this->async_log_queue_size = queue_size; }
+void rest_server::set_log_json(bool log_json) { this->log_json = log_json; }
+void rest_server::set_log_sampling(unsigned status, double rate) { this->log_sampling[status] = rate; }
+void rest_server::set_connection_memory(unsigned initial, unsigned max) {
+  this->connection_memory_initial = initial;
+  this->connection_memory_max = max;
+}
+void rest_server::set_keep_alive(bool keep_alive) { this->keep_alive = keep_alive; }
+void rest_server::set_load_shedding(unsigned target_delay, unsigned interval) {
+  this->load_shedding_target = target_delay;
+  this->load_shedding_interval = interval;
+}
 void rest_server::set_min_generated(unsigned min_generated) { this->min_generated = min_generated; }
 void rest_server::set_max_connections(unsigned max_connections) { this->max_connections = max_connections; }
+void rest_server::set_max_connections_per_ip(unsigned max_connections_per_ip) { this->max_connections_per_ip = max_connections_per_ip; }
 void rest_server::set_max_request_body_size(unsigned max_request_body_size) { this->max_request_body_size = max_request_body_size; }
+void rest_server::set_request_timing(bool log_timing, bool server_timing_header) {
+  this->log_timing = log_timing;
+  this->server_timing_header = server_timing_header;
+}
+void rest_server::set_metrics_url(const std::string& metrics_url) { this->metrics_url = metrics_url; }
+void rest_server::set_rate_limit(double requests_per_second, unsigned burst, unsigned trusted_proxies) {
+  this->rate_limit = requests_per_second;
+  this->rate_limit_burst = burst;
+  this->rate_limit_trusted_proxies = trusted_proxies;
+}
+void rest_server::set_stop_deadline(unsigned stop_deadline) { this->stop_deadline = stop_deadline; }
+void rest_server::set_thread_affinity(const std::vector<unsigned>& cpus) {
+  this->thread_affinity_cpus = cpus;
+  this->thread_affinity_numa = false;
+}
+void rest_server::set_thread_affinity_numa() {
+  this->thread_affinity_cpus.clear();
+  this->thread_affinity_numa = true;
+}
 void rest_server::set_threads(unsigned threads) { this->threads = threads; }
 void rest_server::set_timeout(unsigned timeout) { this->timeout = timeout; }
+void rest_server::set_use_poll(bool use_poll) { this->use_poll = use_poll; }
 
 bool rest_server::start(rest_service* service, unsigned port) {
+  return start_listening(service, port, -1, "port " + to_string(port));
+}
+
+bool rest_server::start_from_fd(rest_service* service, int listen_fd) {
+  if (listen_fd < 0) return false;
+#if !(defined(_WIN32) && !defined(__CYGWIN__))
+  // A blocking socket shared with another process could block the listening
+  // thread in accept() after losing the race for a connection.
+  fcntl(listen_fd, F_SETFD, FD_CLOEXEC);
+  fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+#endif
+  return start_listening(service, 0, listen_fd, "socket fd " + to_string(listen_fd));
+}
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+bool rest_server::start_unix(rest_service* /*service*/, const char* /*path*/, unsigned /*mode*/) {
+  return false;
+}
+int rest_server::handoff_listening_socket() {
+  return -1;
+}
+#else
+bool rest_server::start_unix(rest_service* service, const char* path, unsigned mode) {
+  if (!service || !path) return false;
+
+  sockaddr_un address;
+  if (strlen(path) >= sizeof(address.sun_path)) return false;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  int socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_fd < 0) return false;
+  fcntl(socket_fd, F_SETFD, FD_CLOEXEC);
+
+  // Remove a stale socket left by a previous run, but never other files.
+  struct stat path_stat;
+  if (lstat(path, &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) unlink(path);
+
+  if (::bind(socket_fd, (const sockaddr*) &address, sizeof(address)) != 0)
+    return close(socket_fd), false;
+  if (chmod(path, mode) != 0 || listen(socket_fd, SOMAXCONN) != 0)
+    return close(socket_fd), unlink(path), false;
+
+  unix_socket_path = path;
+  if (!start_listening(service, 0, socket_fd, "unix socket " + unix_socket_path)) {
+    // The daemon might have already closed the socket on failure.
+    if (fcntl(socket_fd, F_GETFD) != -1) close(socket_fd);
+    unlink(path);
+    unix_socket_path.clear();
+    return false;
+  }
+  return true;
+}
+
+int rest_server::handoff_listening_socket() {
+  if (!daemon) return -1;
+
+  auto info = MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_LISTEN_FD);
+  if (!info || info->listen_fd == MHD_INVALID_SOCKET) return -1;
+
+  // The duplicate is not closed on exec, so it can be inherited. It shares
+  // the file status flags with our socket, so make both non-blocking, not
+  // to stay blocked in accept() when the new process accepts a connection.
+  int handoff_fd = dup(info->listen_fd);
+  if (handoff_fd < 0) return -1;
+  fcntl(handoff_fd, F_SETFL, fcntl(handoff_fd, F_GETFL) | O_NONBLOCK);
+
+  // The Unix socket is used by the new process, do not remove it on stop.
+  unix_socket_path.clear();
+  return handoff_fd;
+}
+#endif
+
+static vector<vector<unsigned>> numa_node_cpus() {
+  vector<vector<unsigned>> nodes;
+#ifdef __linux__
+  for (unsigned node = 0; ; node++) {
+    ifstream cpulist("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    if (!cpulist) break;
+
+    // The list has the form like 0-3,8-11.
+    vector<unsigned> cpus;
+    unsigned first, last;
+    while (cpulist >> first) {
+      last = first;
+      if (cpulist.peek() == '-') cpulist.ignore(), cpulist >> last;
+      for (unsigned cpu = first; cpu <= last; cpu++)
+        cpus.push_back(cpu);
+      cpulist.ignore();
+    }
+    if (!cpus.empty()) nodes.push_back(move(cpus));
+  }
+#endif
+  return nodes;
+}
+
+bool rest_server::start_listening(rest_service* service, unsigned port, int listen_socket, const string& listening) {
   if (!service) return false;
   this->service = service;
 
   if (!microhttpd_request::initialize()) return false;
 
-  for (int use_poll = 1; use_poll >= 0; use_poll--) {
+  if (async_log_queue_size && log_file)
+    log_writer.start(async_log_queue_size, [this](const vector<string>& lines) { log_write_lines(lines); });
+
+  client_rate_limiter.set_limit(rate_limit, rate_limit_burst);
+  request_load_shedder.set_target(load_shedding_target, load_shedding_interval);
+  generator_timer.start();
+
+  // Every worker is pinned either to one CPU or to the CPUs of one NUMA node.
+  vector<vector<unsigned>> thread_cpus;
+  if (thread_affinity_numa)
+    thread_cpus = numa_node_cpus();
+  else
+    for (auto&& cpu : thread_affinity_cpus)
+      thread_cpus.push_back({cpu});
+
+  vector<MHD_ThreadAffinity> thread_affinity;
+  for (auto&& cpus : thread_cpus)
+    thread_affinity.push_back({cpus.data(), unsigned(cpus.size())});
+
+  for (int use_poll = this->use_poll; use_poll >= 0; use_poll--) {
     MHD_OptionItem threadpool_size[] = {
       { threads ? MHD_OPTION_THREAD_POOL_SIZE : MHD_OPTION_END, int(threads), nullptr },
       { MHD_OPTION_END, 0, nullptr }
@@ -392,45 +835,95 @@ bool rest_server::start(rest_service* service, unsigned port) {
       { max_connections ? MHD_OPTION_CONNECTION_LIMIT : MHD_OPTION_END, int(max_connections), nullptr },
       { MHD_OPTION_END, 0, nullptr }
     };
+    MHD_OptionItem thread_affinity_sets[] = {
+      { threads && !thread_affinity.empty() ? MHD_OPTION_THREAD_AFFINITY : MHD_OPTION_END, intptr_t(thread_affinity.size()), thread_affinity.data() },
+      { MHD_OPTION_END, 0, nullptr }
+    };
+    MHD_OptionItem listen_socket_fd[] = {
+      { listen_socket >= 0 ? MHD_OPTION_LISTEN_SOCKET : MHD_OPTION_END, intptr_t(listen_socket), nullptr },
+      { MHD_OPTION_END, 0, nullptr }
+    };
 
     daemon = MHD_start_daemon((threads ? MHD_USE_SELECT_INTERNALLY : MHD_USE_THREAD_PER_CONNECTION) | (use_poll ? MHD_USE_POLL : 0) | MHD_USE_PIPE_FOR_SHUTDOWN,
                               port, nullptr, nullptr, &handle_request, this,
                               MHD_OPTION_LISTENING_ADDRESS_REUSE, 1,
                               MHD_OPTION_ARRAY, threadpool_size,
                               MHD_OPTION_ARRAY, connection_limit,
-                              MHD_OPTION_CONNECTION_MEMORY_LIMIT, size_t(64 << 10),
+                              MHD_OPTION_ARRAY, thread_affinity_sets,
+                              MHD_OPTION_ARRAY, listen_socket_fd,
+                              MHD_OPTION_PER_IP_CONNECTION_LIMIT, max_connections_per_ip,
+                              MHD_OPTION_CONNECTION_MEMORY_LIMIT, size_t(connection_memory_max),
+                              MHD_OPTION_CONNECTION_MEMORY_INITIAL, size_t(connection_memory_initial),
                               MHD_OPTION_CONNECTION_TIMEOUT, timeout,
                               MHD_OPTION_NOTIFY_COMPLETED, &request_completed, this,
+                              MHD_OPTION_NOTIFY_CONNECTION, &notify_connection, this,
                               MHD_OPTION_END);
 
     if (daemon) {
-      log("REST server starting, port ", port, ", max connections ", max_connections, ", timeout ", timeout, ", max request body size ", max_request_body_size, ", min generated ", min_generated, '.');
+      // Log the basic settings, and the other ones only when they are used.
+      ostringstream settings;
+      settings << listening << ", max connections " << max_connections << ", timeout " << timeout
+               << ", max request body size " << max_request_body_size << ", min generated " << min_generated;
+      if (max_connections_per_ip) settings << ", max connections per ip " << max_connections_per_ip;
+      if (keep_alive) settings << ", keep alive";
+      if (load_shedding_target) settings << ", load shedding target " << load_shedding_target << "ms interval " << load_shedding_interval << "ms";
+      if (rate_limit) settings << ", rate limit " << rate_limit << " burst " << rate_limit_burst << (rate_limit_trusted_proxies ? " trusted proxies " + to_string(rate_limit_trusted_proxies) : string());
+      if (!metrics_url.empty()) settings << ", metrics url " << metrics_url;
+      if (threads && !thread_affinity.empty()) settings << ", thread affinity " << thread_affinity.size() << " cpu sets";
+      if (log_writer.running()) settings << ", async log queue " << async_log_queue_size;
+      settings << ", connection memory " << connection_memory_initial << '-' << connection_memory_max << ", " << (use_poll ? "poll" : "select");
+      log("REST server starting, ", settings.str(), '.');
       return true;
     }
   }
 
+  log_writer.stop();
   return false;
 }
 
 void rest_server::stop() {
   if (!daemon) return;
 
-  // Quiesce the daemon and wait for current requests to be handled.
+  // Quiesce the daemon and wait for current connections to be closed,
+  // not keeping the connections alive any longer.
   log("REST server closing listening port and waiting for current requests to finish.");
+  stopping = true;
+  generator_timer.stop();
   MHD_socket socket = MHD_quiesce_daemon(daemon);
   if (socket != MHD_INVALID_SOCKET) MHD_socket_close(socket);
-  while (true) {
-    unsigned connections = *(unsigned*) MHD_get_daemon_info(daemon, MHD_DAEMON_INFO_CURRENT_CONNECTIONS);
-    log("There are ", connections, " current connections.");
-    if (!connections) break;
-    this_thread::sleep_for(chrono::milliseconds(500));
+#if !(defined(_WIN32) && !defined(__CYGWIN__))
+  if (!unix_socket_path.empty()) unlink(unix_socket_path.c_str());
+  unix_socket_path.clear();
+#endif
+  // Idle keep-alive connections are closed repeatedly, because connections
+  // whose last response was sent before stopping may become idle later.
+  unsigned remaining;
+  auto deadline = chrono::steady_clock::now() + chrono::seconds(stop_deadline);
+  for (bool first = true; ; first = false) {
+    MHD_close_idle_connections(daemon);
+
+    unique_lock<decltype(connections_mutex)> connections_lock(connections_mutex);
+    if (first) log("There are ", connections, " current connections.");
+
+    auto now = chrono::steady_clock::now();
+    auto wait_until = now + chrono::milliseconds(100);
+    if (stop_deadline && deadline < wait_until) wait_until = deadline;
+    connections_finished.wait_until(connections_lock, wait_until, [this]{ return !connections; });
+    remaining = connections;
+    if (!remaining || (stop_deadline && chrono::steady_clock::now() >= deadline)) break;
   }
+  if (remaining) log("Closing ", remaining, " remaining connections after the stop deadline.");
   log("REST server stopped.");
 
   MHD_stop_daemon(daemon);
   daemon = nullptr;
   service = nullptr;
+  if (log_writer.running()) {
+    log_writer.stop();
+    if (log_writer.dropped()) log("Dropped ", log_writer.dropped(), " log lines, the asynchronous log queue was full.");
+  }
   log_file = nullptr;
+  stopping = false;
 }
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
@@ -494,13 +987,40 @@ int rest_server::handle_request(void* cls, struct MHD_Connection* connection, co
 
   // Do we have a new request?
   if (!request) {
+    // Serve the metrics without calling the service
+    if (!self->metrics_url.empty()) {
+      self->request_metrics.request_started();
+      if (self->metrics_url == url && (strcmp(method, MHD_HTTP_METHOD_GET) == 0 || strcmp(method, MHD_HTTP_METHOD_HEAD) == 0))
+        return self->respond_metrics(connection);
+    }
+
     const char* content_type = MHD_lookup_connection_value (connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_CONTENT_TYPE);
     if (!content_type) content_type = "";
 
     if (!(request = new microhttpd_request(*self, connection, url, content_type, method)))
       return cerr << "Cannot allocate new request!" << endl, MHD_NO;
 
+    // Apply the limits of the service, rejecting too large bodies before reading them
+    request->apply_limits(self->service->limits(*request));
+    request->log_on_completion = self->log_on_completion() || (request->limits && request->limits->log_sampling >= 0);
+
+    // Reject it before reading the body if the client is over its rate limit
+    if (self->client_rate_limiter.enabled() && self->rate_limited(connection)) {
+      self->log_rejected(request, MHD_HTTP_TOO_MANY_REQUESTS);
+      delete request;
+      return MHD_queue_response(connection, MHD_HTTP_TOO_MANY_REQUESTS, microhttpd_request::too_many_requests());
+    }
+    if (request->declared_body_too_large()) {
+      self->log_rejected(request, MHD_HTTP_REQUEST_ENTITY_TOO_LARGE);
+      delete request;
+      return MHD_queue_response(connection, MHD_HTTP_REQUEST_ENTITY_TOO_LARGE, microhttpd_request::too_large());
+    }
+
     *con_cls = request;
+    if (!self->metrics_url.empty()) {
+      request->queued = true;
+      self->request_metrics.request_queued(1);
+    }
     return MHD_YES;
   }
 
@@ -513,47 +1033,192 @@ int rest_server::handle_request(void* cls, struct MHD_Connection* connection, co
     return MHD_YES;
   }
 
-  // Log complete request
-  self->log_request(request);
+  if (request->queued) {
+    request->queued = false;
+    self->request_metrics.request_queued(-1);
+  }
+
+  // Reject the request if it waited too long while the server is overloaded
+  if (self->request_load_shedder.enabled() && !self->request_load_shedder.admit(request->data_received())) {
+    self->log_rejected(request, MHD_HTTP_SERVICE_UNAVAILABLE);
+    return MHD_queue_response(connection, MHD_HTTP_SERVICE_UNAVAILABLE, microhttpd_request::service_unavailable());
+  }
+
+  request->phase_times.body_received = request_timing::clock::now();
+
+  // Log complete request, unless it is logged with its status and timing when completed
+  if (!request->log_on_completion) self->log_request(request);
 
   // Handle complete request
   return request->handle(self->service) ? MHD_YES : MHD_NO;
 }
 
-void rest_server::request_completed(void* /*cls*/, struct MHD_Connection* /*connection*/, void** con_cls, int /*toe*/) {
-  auto request = (const microhttpd_request*) *con_cls;
+bool rest_server::rate_limited(MHD_Connection* connection) {
+  string client;
+
+  // Behind trusted proxies, use the X-Forwarded-For hop added by the outermost
+  // of them (the hops before it can be set by the client arbitrarily).
+  const char* forwarded_for = rate_limit_trusted_proxies ? MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "X-Forwarded-For") : nullptr;
+  if (forwarded_for) {
+    const char* hop = forwarded_for + strlen(forwarded_for);
+    for (unsigned hops = 0; hops < rate_limit_trusted_proxies && hop > forwarded_for; hops++)
+      for (hop--; hop > forwarded_for && hop[-1] != ','; hop--) {}
+    while (*hop == ' ' || *hop == '\t') hop++;
+    size_t len = 0;
+    while (hop[len] && hop[len] != ',' && hop[len] != ' ' && hop[len] != '\t') len++;
+    client.assign(hop, len);
+  }
+
+  // Otherwise use the binary client address (starting with \0 not to clash with
+  // the forwarded addresses); clients not using IP addresses are not limited.
+  if (client.empty()) {
+    auto info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+    auto sock_addr = info ? info->client_addr : nullptr;
+    if (sock_addr && sock_addr->sa_family == AF_INET)
+      client.assign(1, '\0').append((const char*) &((const sockaddr_in*) sock_addr)->sin_addr, sizeof(in_addr));
+    else if (sock_addr && sock_addr->sa_family == AF_INET6)
+      client.assign(1, '\0').append((const char*) &((const sockaddr_in6*) sock_addr)->sin6_addr, sizeof(in6_addr));
+    else
+      return false;
+  }
+
+  return !client_rate_limiter.allow(client);
+}
+
+int rest_server::respond_metrics(MHD_Connection* connection) {
+  unsigned current_connections;
+  {
+    lock_guard<decltype(connections_mutex)> connections_lock(connections_mutex);
+    current_connections = connections;
+  }
+
+  string metrics;
+  request_metrics.export_prometheus(metrics, current_connections, log_writer.dropped());
+
+  unique_ptr<MHD_Response, MHD_ResponseDeleter> response(microhttpd_request::create_metrics_response(metrics, keep_alive && !stopping));
+  if (!response) return MHD_NO;
+  return MHD_queue_response(connection, MHD_HTTP_OK, response.get());
+}
+
+void rest_server::request_completed(void* cls, struct MHD_Connection* connection, void** con_cls, int toe) {
+  auto self = (rest_server*) cls;
+  auto request = (microhttpd_request*) *con_cls;
+
+  if (!self->metrics_url.empty()) {
+    if (request && request->queued) self->request_metrics.request_queued(-1);
+
+    auto code = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_RESPONSE_CODE);
+    auto bytes_received = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_BYTES_RECEIVED);
+    auto bytes_sent = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_BYTES_SENT);
+    auto received = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_REQUEST_RECEIVED);
+    uint64_t now = chrono::duration_cast<chrono::nanoseconds>(load_shedder::clock::now().time_since_epoch()).count();
+    self->request_metrics.request_completed(code ? code->response_code : 0, toe != MHD_REQUEST_TERMINATED_COMPLETED_OK,
+                                            bytes_received ? bytes_received->bytes : 0, bytes_sent ? bytes_sent->bytes : 0,
+                                            received && now > received->request_received ? (now - received->request_received) / 1000 : 0);
+  }
+
+  if (request && self->log_file && request->log_on_completion && request->phase_times.body_received.time_since_epoch().count()) {
+    auto code = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_RESPONSE_CODE);
+    unsigned status = code ? code->response_code : 0;
+    if (self->log_sampled(status, request->limits)) {
+      request->phase_times.last_byte_sent = request_timing::clock::now();
+      self->log_request(request, status);
+    }
+  }
+
   if (request) delete request;
 }
 
+void rest_server::notify_connection(void* cls, struct MHD_Connection* /*connection*/, void** /*socket_context*/, int toe) {
+  auto self = (rest_server*) cls;
+
+  lock_guard<decltype(self->connections_mutex)> connections_lock(self->connections_mutex);
+  if (toe == MHD_CONNECTION_NOTIFY_STARTED) {
+    self->connections++;
+  } else if (!--self->connections) {
+    self->connections_finished.notify_all();
+  }
+}
+
 template <typename... Args> void rest_server::log(Args&&... args) {
   if (!log_file) return;
 
-  // Prepare timestamp
-  char timestamp[32];
-  time_t time_now;
-  time_now = time(nullptr);
-  tm tm_now;
+  // Format the line
+  static thread_local ostringstream line;
+  line.str(string());
+  if (!log_json) {
+    line << log_timestamp(false) << '\t';
+    log_append(line, std::forward<Args>(args)...);
+    return log_write_line(line.str());
+  }
+
+  // In the JSON Lines mode, every message is an object with a time
+  log_append(line, std::forward<Args>(args)...);
+  static thread_local json_builder json;
+  string_piece message = json.clear().object().key("time").value(log_timestamp(true)).key("message").value(line.str()).finish().current();
+  log_write_line(string(message.str, message.len - 1/*\n*/));
+}
+
+void rest_server::log_append(ostream& /*os*/) {}
+template <typename Arg, typename... Args> void rest_server::log_append(ostream& os, Arg&& arg, Args&&... args) {
+  os << arg;
+  log_append(os, std::forward<Args>(args)...);
+}
+
+const char* rest_server::log_timestamp(bool iso_8601) {
+  // Format the timestamp only once a second in every thread
+  static thread_local time_t timestamp_time = 0;
+  static thread_local bool timestamp_iso_8601 = false;
+  static thread_local char timestamp[32];
+  time_t time_now = time(nullptr);
+  if (time_now != timestamp_time || iso_8601 != timestamp_iso_8601) {
+    tm tm_now;
 #if defined(_WIN32) && !defined(__CYGWIN__)
-  localtime_s(&tm_now, &time_now);
+    localtime_s(&tm_now, &time_now);
 #else
-  localtime_r(&time_now, &tm_now);
+    localtime_r(&time_now, &tm_now);
 #endif
-  size_t len = strftime(timestamp, sizeof(timestamp), "%a %d. %b %Y %H:%M:%S\t", &tm_now);
+    strftime(timestamp, sizeof(timestamp), iso_8601 ? "%Y-%m-%dT%H:%M:%S%z" : "%a %d. %b %Y %H:%M:%S", &tm_now);
+    timestamp_time = time_now;
+    timestamp_iso_8601 = iso_8601;
+  }
+  return timestamp;
+}
 
-  // Locked using the log_file_mutex
-  {
+void rest_server::log_write_line(string&& line) {
+  // Pass the line to the asynchronous writer, or write it locked using the log_file_mutex
+  if (log_writer.running()) {
+    log_writer.push(std::move(line));
+  } else {
     lock_guard<decltype(log_file_mutex)> log_file_lock(log_file_mutex);
-
-    if (len) *log_file << timestamp;
-    log_append(std::forward<Args>(args)...);
-    *log_file << endl;
+    if (log_file) *log_file << line << endl;
   }
 }
 
-void rest_server::log_append() {}
-template <typename Arg, typename... Args> void rest_server::log_append(Arg&& arg, Args&&... args) {
-  *log_file << arg;
-  log_append(std::forward<Args>(args)...);
+void rest_server::log_write_lines(const vector<string>& lines) {
+  lock_guard<decltype(log_file_mutex)> log_file_lock(log_file_mutex);
+  if (!log_file) return;
+
+  for (auto&& line : lines)
+    log_file->write(line.data(), line.size()).put('\n');
+  log_file->flush();
+}
+
+bool rest_server::log_truncate(const string& value, string_piece& head, string_piece& tail) const {
+  if (!max_log_size || value.size() < max_log_size) return false;
+
+  struct utf8_helper {
+    static bool valid_start(char chr) { return uint8_t(chr) < uint8_t(0x80) || uint8_t(chr) >= uint8_t(0xE0); }
+  };
+
+  size_t utf8_border = max_log_size >> 1;
+  while (utf8_border && !utf8_helper::valid_start(value[utf8_border])) utf8_border--;
+  head = string_piece(value.data(), utf8_border);
+
+  utf8_border = value.size() - (max_log_size >> 1);
+  while (utf8_border < value.size() && !utf8_helper::valid_start(value[utf8_border])) utf8_border++;
+  tail = string_piece(value.data() + utf8_border, value.size() - utf8_border);
+  return true;
 }
 
 void rest_server::log_append_pair(string& message, const char* key, const string& value) {
@@ -566,22 +1231,11 @@ void rest_server::log_append_pair(string& message, const char* key, const string
     message.append(length);
   }
 
-  if (!max_log_size || value.size() < max_log_size) {
+  string_piece head, tail;
+  if (!log_truncate(value, head, tail)) {
     message.append(value);
   } else {
-    struct utf8_helper {
-      static bool valid_start(char chr) { return uint8_t(chr) < uint8_t(0x80) || uint8_t(chr) >= uint8_t(0xE0); }
-    };
-
-    size_t utf8_border = max_log_size >> 1;
-    while (utf8_border && !utf8_helper::valid_start(value[utf8_border])) utf8_border--;
-    message.append(value, 0, utf8_border);
-
-    message.append(" ... ");
-
-    utf8_border = value.size() - (max_log_size >> 1);
-    while (utf8_border < value.size() && !utf8_helper::valid_start(value[utf8_border])) utf8_border++;
-    message.append(value, utf8_border, value.size() - utf8_border);
+    message.append(head.str, head.len).append(" ... ").append(tail.str, tail.len);
   }
 
   // Map the \t, \r, \n in the appended message.
@@ -593,7 +1247,57 @@ void rest_server::log_append_pair(string& message, const char* key, const string
     }
 }
 
-void rest_server::log_request(const microhttpd_request* request) {
+void rest_server::log_append_timing(string& message, const request_timing& timing) {
+  // Durations of the reached phases in milliseconds.
+  message.append("\ttiming:");
+  bool first = true;
+  log_timing_phases(timing, [&message, &first](const char* name, request_timing::clock::duration duration) {
+    char formatted[32];
+    snprintf(formatted, sizeof(formatted), "%s%s=%.3f", first ? "" : ",", name, chrono::duration<double, milli>(duration).count());
+    message.append(formatted);
+    first = false;
+  });
+}
+
+template<typename Callback> void rest_server::log_timing_phases(const request_timing& timing, Callback callback) {
+  struct phase { const char* name; request_timing::clock::time_point start, end; };
+  phase phases[] = {
+    {"connection", timing.connection_accepted, timing.request_received},
+    {"wait", timing.request_received, timing.headers_received},
+    {"upload", timing.headers_received, timing.body_received},
+    {"queue", timing.body_received, timing.handle_started},
+    {"handle", timing.handle_started, timing.handle_finished},
+    {"generate", timing.handle_finished, timing.first_byte_generated},
+    {"send", timing.handle_finished, timing.last_byte_sent},
+  };
+
+  for (auto&& phase : phases)
+    if (phase.start.time_since_epoch().count() && phase.end.time_since_epoch().count())
+      callback(phase.name, phase.end - phase.start);
+}
+
+bool rest_server::log_on_completion() const {
+  return log_timing || log_json || !log_sampling.empty();
+}
+
+bool rest_server::log_sampled(unsigned status, const request_limits* limits) const {
+  // Use the rate of the exact status, then of the status class, then of the
+  // request limits for successful requests, and log everything otherwise
+  double rate = 1;
+  auto status_rate = log_sampling.find(status);
+  if (status_rate == log_sampling.end()) status_rate = log_sampling.find(status / 100);
+  if (status_rate != log_sampling.end())
+    rate = status_rate->second;
+  else if (limits && limits->log_sampling >= 0 && status / 100 == 2)
+    rate = limits->log_sampling;
+  if (rate >= 1) return true;
+  if (rate <= 0) return false;
+
+  static thread_local minstd_rand generator(unsigned(hash<thread::id>()(this_thread::get_id()) ^ chrono::steady_clock::now().time_since_epoch().count()));
+  return uniform_real_distribution<double>()(generator) < rate;
+}
+
+void rest_server::log_request(const microhttpd_request* request, unsigned status) {
   if (!log_file) return;
 
   auto sock_addr = request->address();
@@ -603,6 +1307,8 @@ void rest_server::log_request(const microhttpd_request* request) {
 
   auto forwarded_for = request->forwarded_for();
 
+  if (log_json) return log_request_json(request, address, forwarded_for ? forwarded_for : "", status);
+
   string data;
   log_append_pair(data, "body", request->body);
   for (auto&& param : request->params) {
@@ -610,8 +1316,55 @@ void rest_server::log_request(const microhttpd_request* request) {
     log_append_pair(data, param.first.c_str(), param.second);
   }
 
+  if (status) data.append("\tstatus:").append(to_string(status));
+  if (log_timing) log_append_timing(data, request->phase_times);
+
   log("Request\t", address, '\t', forwarded_for ? forwarded_for : "", '\t', request->url, '\t', data);
 }
 
+void rest_server::log_rejected(const microhttpd_request* request, unsigned status) {
+  // Requests rejected before being handled are logged immediately with their status
+  if (!log_file || (request->log_on_completion && !log_sampled(status, request->limits))) return;
+  log_request(request, status);
+}
+
+void rest_server::log_request_json(const microhttpd_request* request, const char* address, const char* forwarded_for, unsigned status) {
+  static thread_local json_builder json;
+  string_piece head, tail;
+
+  json.clear().object();
+  json.key("time").value(log_timestamp(true));
+  json.key("address").value(address);
+  json.key("forwarded_for").value(forwarded_for);
+  json.key("method").value(request->method);
+  json.key("url").value(request->url);
+  json.key("status").value(status);
+  json.key("body_length").value((unsigned long long) request->body.size());
+  if (!log_truncate(request->body, head, tail))
+    json.key("body").value(request->body);
+  else
+    json.key("body").value(head).value(" ... ", true).value(tail, true);
+
+  json.key("params").object();
+  for (auto&& param : request->params)
+    if (!log_truncate(param.second, head, tail))
+      json.key(param.first).value(param.second);
+    else
+      json.key(param.first).value(head).value(" ... ", true).value(tail, true);
+  json.close();
+
+  // Durations of the reached phases in microseconds.
+  if (log_timing) {
+    json.key("timing_us").object();
+    log_timing_phases(request->phase_times, [](const char* name, request_timing::clock::duration duration) {
+      json.key(name).value((long long) chrono::duration_cast<chrono::microseconds>(duration).count());
+    });
+    json.close();
+  }
+
+  string_piece line = json.finish().current();
+  log_write_line(string(line.str, line.len - 1/*\n*/));
+}
+
 } // namespace microrestd
 } // namespace ufal
@@ -9,12 +9,22 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <map>
 #include <mutex>
 #include <ostream>
 #include <string>
+#include <vector>
 
+#include "async_log_writer.h"
+#include "load_shedder.h"
+#include "rate_limiter.h"
 #include "rest_request.h"
 #include "rest_service.h"
+#include "server_metrics.h"
+#include "string_piece.h"
+#include "wake_up_timer.h"
 
 namespace ufal {
 namespace microrestd {
@@ -28,40 +38,103 @@ struct MHD_Connection;
 class rest_server {
  public:
   void set_log_file(std::ostream* log_file, unsigned max_log_size = 0);
+  void set_async_log(unsigned queue_size);
+  void set_log_json(bool log_json);
+  void set_log_sampling(unsigned status, double rate);
+  void set_connection_memory(unsigned initial, unsigned max);
+  void set_keep_alive(bool keep_alive);
+  void set_load_shedding(unsigned target_delay, unsigned interval = 100);
   void set_min_generated(unsigned min_generated);
   void set_max_connections(unsigned max_connections);
+  void set_max_connections_per_ip(unsigned max_connections_per_ip);
   void set_max_request_body_size(unsigned max_request_body_size);
+  void set_metrics_url(const std::string& metrics_url);
+  void set_rate_limit(double requests_per_second, unsigned burst, unsigned trusted_proxies = 0);
+  void set_request_timing(bool log_timing, bool server_timing_header = false);
+  void set_stop_deadline(unsigned stop_deadline);
+  void set_thread_affinity(const std::vector<unsigned>& cpus);
+  void set_thread_affinity_numa();
   void set_threads(unsigned threads);
   void set_timeout(unsigned timeout);
+  void set_use_poll(bool use_poll);
 
   bool start(rest_service* service, unsigned port);
+  bool start_unix(rest_service* service, const char* path, unsigned mode = 0660);
+  bool start_from_fd(rest_service* service, int listen_fd);
+  int handoff_listening_socket();
   void stop();
   bool wait_until_signalled();
 
  private:
   class microhttpd_request;
 
+  bool start_listening(rest_service* service, unsigned port, int listen_socket, const std::string& listening);
+
   static int handle_request(void* cls, libmicrohttpd::MHD_Connection* connection, const char* url, const char* method, const char* version, const char* upload_data, size_t* upload_data_size, void** con_cls);
+  bool rate_limited(libmicrohttpd::MHD_Connection* connection);
+  int respond_metrics(libmicrohttpd::MHD_Connection* connection);
+
   static void request_completed(void* cls, libmicrohttpd::MHD_Connection* connection, void** con_cls, int toe);
+  static void notify_connection(void* cls, libmicrohttpd::MHD_Connection* connection, void** socket_context, int toe);
 
   template<typename... Args> void log(Args&&... args);
-  void log_append();
-  template<typename Arg, typename... Args> void log_append(Arg&& arg, Args&&... args);
+  static void log_append(std::ostream& os);
+  template<typename Arg, typename... Args> static void log_append(std::ostream& os, Arg&& arg, Args&&... args);
+  static const char* log_timestamp(bool iso_8601);
+  void log_write_line(std::string&& line);
+  void log_write_lines(const std::vector<std::string>& lines);
+  bool log_truncate(const std::string& value, string_piece& head, string_piece& tail) const;
   void log_append_pair(std::string& message, const char* key, const std::string& value);
-  void log_request(const microhttpd_request* request);
+  void log_append_timing(std::string& message, const request_timing& timing);
+  template<typename Callback> static void log_timing_phases(const request_timing& timing, Callback callback);
+  bool log_on_completion() const;
+  bool log_sampled(unsigned status, const request_limits* limits) const;
+  void log_request(const microhttpd_request* request, unsigned status = 0);
+  void log_rejected(const microhttpd_request* request, unsigned status);
+  void log_request_json(const microhttpd_request* request, const char* address, const char* forwarded_for, unsigned status);
 
   libmicrohttpd::MHD_Daemon* daemon = nullptr;
   rest_service* service = nullptr;
+  std::string unix_socket_path;
+
+  std::mutex connections_mutex;
+  std::condition_variable connections_finished;
+  unsigned connections = 0;
+  std::atomic<bool> stopping{false};
+  mutable wake_up_timer generator_timer;
 
   std::ostream* log_file = nullptr;
   std::mutex log_file_mutex;
   unsigned max_log_size = 0;
+  unsigned async_log_queue_size = 0;
+  async_log_writer log_writer;
+  bool log_json = false;
+  std::map<unsigned, double> log_sampling;
 
+  unsigned connection_memory_initial = 8 << 10;
+  unsigned connection_memory_max = 64 << 10;
+  bool keep_alive = false;
+  unsigned load_shedding_target = 0;
+  unsigned load_shedding_interval = 0;
+  load_shedder request_load_shedder;
   unsigned min_generated = 1 << 10;
   unsigned max_connections = 0;
+  unsigned max_connections_per_ip = 0;
   unsigned max_request_body_size = 0;
+  std::string metrics_url;
+  server_metrics request_metrics;
+  double rate_limit = 0;
+  unsigned rate_limit_burst = 0;
+  unsigned rate_limit_trusted_proxies = 0;
+  rate_limiter client_rate_limiter;
+  bool log_timing = false;
+  bool server_timing_header = false;
+  unsigned stop_deadline = 0;
+  std::vector<unsigned> thread_affinity_cpus;
+  bool thread_affinity_numa = false;
   unsigned threads = 0;
   unsigned timeout = 0;
+  bool use_poll = true;
 };
 
 } // namespace microrestd
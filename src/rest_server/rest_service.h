@@ -11,6 +11,7 @@
 
 #include <unordered_map>
 
+#include "request_limits.h"
 #include "rest_request.h"
 
 namespace ufal {
@@ -19,6 +20,10 @@ namespace microrestd {
 class rest_service {
  public:
   virtual bool handle(rest_request& req) = 0;
+
+  // Optional limits of a request, looked up when its headers are received
+  // (so the body and the POST params are not available yet).
+  virtual const request_limits* limits(const rest_request& /*req*/) { return nullptr; }
 };
 
 } // namespace microrestd
@@ -0,0 +1,121 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdio>
+
+#include "server_metrics.h"
+
+namespace ufal {
+namespace microrestd {
+
+void server_metrics::request_completed(unsigned status, bool failed, uint64_t bytes_received, uint64_t bytes_sent, uint64_t latency_us) {
+  auto& slot = current_slot();
+
+  if (status >= 100 && status < 100 * (status_classes + 1))
+    slot.requests[status / 100 - 1].fetch_add(1, std::memory_order_relaxed);
+  if (failed) slot.requests_failed.fetch_add(1, std::memory_order_relaxed);
+  slot.bytes_received.fetch_add(bytes_received, std::memory_order_relaxed);
+  slot.bytes_sent.fetch_add(bytes_sent, std::memory_order_relaxed);
+  slot.in_flight.fetch_sub(1, std::memory_order_relaxed);
+  slot.latency_sum.fetch_add(latency_us, std::memory_order_relaxed);
+  // The buckets are indexed by the latency minus one, so that a latency equal to
+  // a histogram bound is counted in it (the bounds are inclusive in Prometheus).
+  slot.latency[latency_bucket(latency_us ? latency_us - 1 : 0)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void server_metrics::export_prometheus(std::string& output, unsigned connections, uint64_t dropped_log_lines) const {
+  // Merge the slots.
+  uint64_t requests[status_classes] = {}, requests_failed = 0, bytes_received = 0, bytes_sent = 0, latency_sum = 0, latency[latency_buckets] = {};
+  int64_t in_flight = 0, queued = 0;
+  for (auto&& slot : slots) {
+    for (unsigned i = 0; i < status_classes; i++)
+      requests[i] += slot.requests[i].load(std::memory_order_relaxed);
+    requests_failed += slot.requests_failed.load(std::memory_order_relaxed);
+    bytes_received += slot.bytes_received.load(std::memory_order_relaxed);
+    bytes_sent += slot.bytes_sent.load(std::memory_order_relaxed);
+    in_flight += slot.in_flight.load(std::memory_order_relaxed);
+    queued += slot.queued.load(std::memory_order_relaxed);
+    latency_sum += slot.latency_sum.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < latency_buckets; i++)
+      latency[i] += slot.latency[i].load(std::memory_order_relaxed);
+  }
+
+  char line[128];
+  auto metric = [&output](const char* name, const char* type, const char* help) {
+    output.append("# HELP ").append(name).append(" ").append(help).append("\n");
+    output.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+  };
+
+  metric("microrestd_requests_total", "counter", "Completed requests by status class.");
+  for (unsigned i = 0; i < status_classes; i++)
+    output.append(line, snprintf(line, sizeof(line), "microrestd_requests_total{code=\"%uxx\"} %llu\n", i + 1, (unsigned long long) requests[i]));
+  metric("microrestd_requests_failed_total", "counter", "Requests terminated by an error or a closed connection.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_requests_failed_total %llu\n", (unsigned long long) requests_failed));
+  metric("microrestd_received_bytes_total", "counter", "Bytes received, including headers.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_received_bytes_total %llu\n", (unsigned long long) bytes_received));
+  metric("microrestd_sent_bytes_total", "counter", "Bytes sent, including headers.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_sent_bytes_total %llu\n", (unsigned long long) bytes_sent));
+  metric("microrestd_requests_in_flight", "gauge", "Requests being received, handled or sent.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_requests_in_flight %lld\n", (long long) in_flight));
+  metric("microrestd_requests_queued", "gauge", "Requests not yet passed to the service.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_requests_queued %lld\n", (long long) queued));
+  metric("microrestd_connections", "gauge", "Open connections.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_connections %u\n", connections));
+  metric("microrestd_log_dropped_lines_total", "counter", "Log lines dropped because the asynchronous log queue was full.");
+  output.append(line, snprintf(line, sizeof(line), "microrestd_log_dropped_lines_total %llu\n", (unsigned long long) dropped_log_lines));
+
+  // The histogram uses power-of-two bounds, each covering whole buckets.
+  uint64_t count = 0;
+  unsigned bucket = 0;
+  metric("microrestd_request_duration_seconds", "histogram", "Time from receiving a request to sending its response.");
+  for (uint64_t bound = 16; bound <= uint64_t(1) << 32; bound <<= 1) {
+    for (; latency_bucket_start(bucket) < bound; bucket++)
+      count += latency[bucket];
+    output.append(line, snprintf(line, sizeof(line), "microrestd_request_duration_seconds_bucket{le=\"%.9g\"} %llu\n", bound / 1e6, (unsigned long long) count));
+  }
+  for (; bucket < latency_buckets; bucket++)
+    count += latency[bucket];
+  output.append(line, snprintf(line, sizeof(line), "microrestd_request_duration_seconds_bucket{le=\"+Inf\"} %llu\n", (unsigned long long) count));
+  output.append(line, snprintf(line, sizeof(line), "microrestd_request_duration_seconds_sum %.6f\n", latency_sum / 1e6));
+  output.append(line, snprintf(line, sizeof(line), "microrestd_request_duration_seconds_count %llu\n", (unsigned long long) count));
+
+  // The quantiles use the middle of the bucket, with at most 6.25% error.
+  metric("microrestd_request_duration_quantile_seconds", "gauge", "Quantiles of the request duration.");
+  for (auto&& quantile : {0.5, 0.9, 0.99, 0.999}) {
+    uint64_t rank = uint64_t(count * quantile), seen = 0;
+    for (bucket = 0; bucket + 1 < latency_buckets && seen + latency[bucket] <= rank; bucket++)
+      seen += latency[bucket];
+    double value = count ? (latency_bucket_start(bucket) + latency_bucket_start(bucket + 1) + 2) / 2e6 : 0;
+    output.append(line, snprintf(line, sizeof(line), "microrestd_request_duration_quantile_seconds{quantile=\"%g\"} %g\n", quantile, value));
+  }
+}
+
+server_metrics::slot& server_metrics::current_slot() {
+  static std::atomic<unsigned> threads{0};
+  static thread_local unsigned thread_slot = threads++ % slots_size;
+  return slots[thread_slot];
+}
+
+unsigned server_metrics::latency_bucket(uint64_t latency_us) {
+  if (latency_us < sub_buckets) return unsigned(latency_us);
+
+  // Values in [2^e, 2^(e+1)) are split into sub_buckets linear buckets.
+  unsigned exponent = 3;
+  while (latency_us >> (exponent + 1)) exponent++;
+  unsigned bucket = (exponent - 2) * sub_buckets + unsigned((latency_us >> (exponent - 3)) & (sub_buckets - 1));
+  return bucket < latency_buckets ? bucket : latency_buckets - 1;
+}
+
+uint64_t server_metrics::latency_bucket_start(unsigned bucket) {
+  if (bucket < sub_buckets) return bucket;
+  return uint64_t(sub_buckets + bucket % sub_buckets) << (bucket / sub_buckets - 1);
+}
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,51 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace ufal {
+namespace microrestd {
+
+// Request counters and a log-linear latency histogram. Every thread updates
+// one of several cache-line-padded slots, which are merged when exported.
+class server_metrics {
+ public:
+  void request_started() { current_slot().in_flight.fetch_add(1, std::memory_order_relaxed); }
+  void request_queued(int delta) { current_slot().queued.fetch_add(delta, std::memory_order_relaxed); }
+  void request_completed(unsigned status, bool failed, uint64_t bytes_received, uint64_t bytes_sent, uint64_t latency_us);
+
+  // Append the metrics in the Prometheus text format.
+  void export_prometheus(std::string& output, unsigned connections, uint64_t dropped_log_lines) const;
+
+ private:
+  enum { slots_size = 16, status_classes = 5, sub_buckets = 8, latency_buckets = sub_buckets * 40 };
+
+  struct slot {
+    std::atomic<uint64_t> requests[status_classes] = {};
+    std::atomic<uint64_t> requests_failed{0};
+    std::atomic<uint64_t> bytes_received{0}, bytes_sent{0};
+    std::atomic<int64_t> in_flight{0}, queued{0};
+    std::atomic<uint64_t> latency_sum{0};
+    std::atomic<uint64_t> latency[latency_buckets] = {};
+    char padding[64];
+  };
+
+  slot& current_slot();
+  static unsigned latency_bucket(uint64_t latency_us);
+  static uint64_t latency_bucket_start(unsigned bucket);
+
+  slot slots[slots_size];
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,123 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include "sse_response_generator.h"
+
+namespace ufal {
+namespace microrestd {
+
+const char* sse_response_generator::mime = "text/event-stream";
+
+// Class sse_response_generator::stream
+bool sse_response_generator::stream::event(string_piece data, string_piece event, string_piece id) {
+  struct field_helper {
+    static void append(std::vector<char>& events, const char* name, string_piece value) {
+      events.insert(events.end(), name, name + strlen(name));
+      for (; value.len; value.str++, value.len--)
+        if (*value.str != '\r' && *value.str != '\n')
+          events.push_back(*value.str);
+      events.push_back('\n');
+    }
+  };
+
+  std::function<void()> resume_generator;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (disconnected) return false;
+    if (closed) return true;
+
+    if (event.len) field_helper::append(events, "event: ", event);
+    if (id.len) field_helper::append(events, "id: ", id);
+
+    // Every line of the data is sent as a separate data field.
+    do {
+      const char* line_end = (const char*) memchr(data.str, '\n', data.len);
+      size_t line_len = line_end ? line_end - data.str : data.len;
+      field_helper::append(events, "data: ", string_piece(data.str, line_len));
+      data.str += line_end ? line_len + 1 : line_len;
+      data.len -= line_end ? line_len + 1 : line_len;
+    } while (data.len);
+    events.push_back('\n');
+    resume_generator.swap(resume);
+  }
+  if (resume_generator) resume_generator();
+  return true;
+}
+
+void sse_response_generator::stream::close() {
+  std::function<void()> resume_generator;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    resume_generator.swap(resume);
+  }
+  if (resume_generator) resume_generator();
+}
+
+// Class sse_response_generator
+sse_response_generator::sse_response_generator(unsigned heartbeat) : shared_stream(std::make_shared<stream>()), heartbeat(heartbeat), last_sent(std::chrono::steady_clock::now()) {}
+
+sse_response_generator::~sse_response_generator() {
+  std::lock_guard<std::mutex> lock(shared_stream->mutex);
+  shared_stream->disconnected = true;
+  shared_stream->resume = nullptr;
+}
+
+std::shared_ptr<sse_response_generator::stream> sse_response_generator::events() const {
+  return shared_stream;
+}
+
+bool sse_response_generator::generate() {
+  std::lock_guard<std::mutex> lock(shared_stream->mutex);
+  auto now = std::chrono::steady_clock::now();
+
+  if (!shared_stream->events.empty()) {
+    data.insert(data.end(), shared_stream->events.begin(), shared_stream->events.end());
+    shared_stream->events.clear();
+    last_sent = now;
+    return true;
+  }
+  if (shared_stream->closed) return false;
+
+  // Send a heartbeat comment if there were no events in time.
+  if (heartbeat && now - last_sent >= std::chrono::seconds(heartbeat)) {
+    data.push_back(':'); data.push_back('\n'); data.push_back('\n');
+    last_sent = now;
+  }
+  return true;
+}
+
+string_piece sse_response_generator::current() const {
+  return string_piece(data.data(), data.size());
+}
+
+void sse_response_generator::consume(size_t length) {
+  if (length >= data.size()) data.clear();
+  else if (length) data.erase(data.begin(), data.begin() + length);
+}
+
+bool sse_response_generator::flush() const {
+  return true;
+}
+
+bool sse_response_generator::wait(const std::function<void()>& resume, unsigned& wake_after) {
+  std::lock_guard<std::mutex> lock(shared_stream->mutex);
+  if (!shared_stream->events.empty() || shared_stream->closed) return false;
+
+  // Resumed by the next event or when the heartbeat is due.
+  shared_stream->resume = resume;
+  if (heartbeat) {
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(last_sent + std::chrono::seconds(heartbeat) - std::chrono::steady_clock::now()).count();
+    wake_after = remaining > 0 ? unsigned(remaining) + 1 : 1;
+  }
+  return true;
+}
+
+} // namespace microrestd
+} // namespace ufal
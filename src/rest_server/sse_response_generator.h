@@ -0,0 +1,64 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "response_generator.h"
+
+namespace ufal {
+namespace microrestd {
+
+class sse_response_generator : public response_generator {
+ public:
+  // Event stream shared by the generator and the producer of the events.
+  class stream {
+   public:
+    // Send an event; returns false if the client has already disconnected.
+    bool event(string_piece data, string_piece event = string_piece(), string_piece id = string_piece());
+    // End the event stream.
+    void close();
+
+   private:
+    friend class sse_response_generator;
+
+    std::mutex mutex;
+    std::vector<char> events;
+    std::function<void()> resume;
+    bool closed = false;
+    bool disconnected = false;
+  };
+
+  sse_response_generator(unsigned heartbeat = 15);
+  virtual ~sse_response_generator() override;
+
+  std::shared_ptr<stream> events() const;
+
+  virtual bool generate() override;
+  virtual string_piece current() const override;
+  virtual void consume(size_t length) override;
+  virtual bool flush() const override;
+  virtual bool wait(const std::function<void()>& resume, unsigned& wake_after) override;
+
+  static const char* mime;
+
+ private:
+  std::shared_ptr<stream> shared_stream;
+  std::vector<char> data;
+  unsigned heartbeat;
+  std::chrono::steady_clock::time_point last_sent;
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,84 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <vector>
+
+#include "wake_up_timer.h"
+
+namespace ufal {
+namespace microrestd {
+
+void wake_up_timer::start() {
+  std::lock_guard<std::mutex> lock(timer_mutex);
+  stopped = false;
+}
+
+void wake_up_timer::stop() {
+  std::map<handle, std::function<void()>> pending;
+  {
+    std::lock_guard<std::mutex> lock(timer_mutex);
+    stopped = true;
+    pending.swap(callbacks);
+  }
+  timer_wakeup.notify_all();
+  if (caller.joinable()) caller.join();
+
+  for (auto&& callback : pending)
+    callback.second();
+}
+
+wake_up_timer::handle wake_up_timer::schedule(clock::time_point when, std::function<void()> callback) {
+  {
+    std::unique_lock<std::mutex> lock(timer_mutex);
+    if (!stopped) {
+      handle scheduled(when, next_id++);
+      bool earliest = callbacks.empty() || scheduled < callbacks.begin()->first;
+      callbacks.emplace(scheduled, std::move(callback));
+      if (!caller.joinable()) caller = std::thread(&wake_up_timer::call_callbacks, this);
+      lock.unlock();
+      if (earliest) timer_wakeup.notify_all();
+      return scheduled;
+    }
+  }
+
+  callback();
+  return handle();
+}
+
+void wake_up_timer::cancel(const handle& scheduled) {
+  std::lock_guard<std::mutex> lock(timer_mutex);
+  callbacks.erase(scheduled);
+}
+
+void wake_up_timer::call_callbacks() {
+  std::vector<std::function<void()>> due;
+  std::unique_lock<std::mutex> lock(timer_mutex);
+  while (!stopped) {
+    if (callbacks.empty() || callbacks.begin()->first.first == clock::time_point::max())
+      timer_wakeup.wait(lock);
+    else
+      timer_wakeup.wait_until(lock, callbacks.begin()->first.first);
+
+    // Call the due callbacks without holding the lock.
+    auto now = clock::now();
+    while (!callbacks.empty() && callbacks.begin()->first.first <= now) {
+      due.push_back(std::move(callbacks.begin()->second));
+      callbacks.erase(callbacks.begin());
+    }
+    if (!due.empty()) {
+      lock.unlock();
+      for (auto&& callback : due) callback();
+      due.clear();
+      lock.lock();
+    }
+  }
+}
+
+} // namespace microrestd
+} // namespace ufal
@@ -0,0 +1,54 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace ufal {
+namespace microrestd {
+
+// Callbacks called at given times by a background thread started on demand.
+// When stopped, all pending callbacks are called immediately, and so are the
+// callbacks scheduled later, until the timer is started again.
+class wake_up_timer {
+ public:
+  typedef std::chrono::steady_clock clock;
+  typedef std::pair<clock::time_point, uint64_t> handle;
+
+  ~wake_up_timer() { stop(); }
+
+  void start();
+  void stop();
+
+  // Schedule the callback, returning a handle which can be used to cancel it.
+  // Callbacks scheduled at clock::time_point::max() are called only on stop.
+  handle schedule(clock::time_point when, std::function<void()> callback);
+  void cancel(const handle& scheduled);
+
+ private:
+  void call_callbacks();
+
+  std::map<handle, std::function<void()>> callbacks;
+  uint64_t next_id = 1;
+  std::thread caller;
+  std::mutex timer_mutex;
+  std::condition_variable timer_wakeup;
+  bool stopped = false;
+};
+
+} // namespace microrestd
+} // namespace ufal
@@ -24,11 +24,18 @@ xml_builder& xml_builder::declaration() {
 void xml_builder::discard_current_prefix(size_t length) {
   if (!length) return;
 
-  if (length < xml.size())
-    xml.erase(xml.begin(), xml.begin() + length);
-  else
+  // Skip the prefix, compacting only when it is longer than the rest of the
+  // buffer, so that the erase is amortized over the discarded data.
+  if (length < xml.size() - xml_offset) {
+    xml_offset += length;
+    if (xml_offset >= xml.size() - xml_offset) {
+      xml.erase(xml.begin(), xml.begin() + xml_offset);
+      xml_offset = 0;
+    }
+  } else {
     xml.clear();
-  if (!length) return;
+    xml_offset = 0;
+  }
 }
 
 void xml_builder::encode(string_piece str) {
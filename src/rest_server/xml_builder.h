@@ -51,6 +51,7 @@ class xml_builder {
   void encode(string_piece str);
 
   std::vector<char> xml;
+  size_t xml_offset = 0;
   std::vector<std::string> stack;
   size_t stack_length = 0;
   mode_t mode = NORMAL;
@@ -59,6 +60,7 @@ class xml_builder {
 // Definitions
 xml_builder& xml_builder::clear() {
   xml.clear();
+  xml_offset = 0;
   stack.clear();
   stack_length = 0;
   mode = NORMAL;
@@ -133,7 +135,7 @@ xml_builder& xml_builder::finish(bool indent) {
 }
 
 string_piece xml_builder::current() const {
-  return string_piece(xml.data(), xml.size());
+  return string_piece(xml.data() + xml_offset, xml.size() - xml_offset);
 }
 
 xml_builder::operator string_piece() const {
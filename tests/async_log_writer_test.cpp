@@ -0,0 +1,86 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "rest_server/async_log_writer.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+int main(void) {
+  bool ok = true;
+  auto report = [&](const char* check, bool result) {
+    cout << check << ": " << (result ? "yes" : "no") << endl;
+    ok &= result;
+  };
+
+  mutex written_mutex;
+  vector<string> written;
+  auto writer = [&](const vector<string>& lines) {
+    lock_guard<mutex> lock(written_mutex);
+    written.insert(written.end(), lines.begin(), lines.end());
+  };
+
+  // Lines pushed by a single thread are written in order, and all pending
+  // lines are written when the writer is destroyed.
+  {
+    async_log_writer log;
+    log.start(4096, writer);
+    report("running after start", log.running());
+    for (int i = 0; i < 3000; i++)
+      log.push("line " + to_string(i));
+  }
+  bool ordered = written.size() == 3000;
+  for (size_t i = 0; ordered && i < written.size(); i++)
+    ordered = written[i] == "line " + to_string(i);
+  report("all lines written in order on destruction", ordered);
+
+  // Lines of several threads keep the order of every thread.
+  written.clear();
+  {
+    async_log_writer log;
+    log.start(1 << 16, writer);
+    vector<thread> threads;
+    for (int t = 0; t < 4; t++)
+      threads.emplace_back([&log, t] {
+        for (int i = 0; i < 5000; i++) log.push(to_string(t) + " " + to_string(i));
+      });
+    for (auto&& thread : threads) thread.join();
+    log.stop();
+    report("stopped", !log.running());
+  }
+  vector<int> next(4, 0);
+  bool per_thread_ordered = written.size() == 20000;
+  for (auto&& line : written)
+    per_thread_ordered &= stoi(line.substr(2)) == next[line[0] - '0']++;
+  report("lines of every thread written in order", per_thread_ordered);
+
+  // When the buffer is full, lines are dropped and counted.
+  written.clear();
+  {
+    mutex blocked;
+    blocked.lock();
+    async_log_writer log;
+    log.start(4, [&](const vector<string>& lines) { lock_guard<mutex> lock(blocked); writer(lines); });
+    unsigned pushed = 0;
+    for (int i = 0; i < 100; i++)
+      pushed += log.push("line " + to_string(i));
+    report("full buffer drops lines", pushed < 100 && log.dropped() == 100 - pushed);
+    blocked.unlock();
+    log.stop();
+    report("pushed lines written", written.size() == pushed);
+  }
+
+  return ok ? 0 : 1;
+}
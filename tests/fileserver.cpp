@@ -42,6 +42,18 @@ class file_service : public rest_service {
       if (length >= data.size()) data.clear();
       else if (length) data.erase(data.begin(), data.begin() + length);
     }
+    virtual bool seekable(uint64_t& length) const override {
+      // Determine the length without moving the current position.
+      auto position = f->tellg();
+      length = f->seekg(0, ifstream::end).tellg();
+      f->seekg(position);
+      return bool(*f);
+    }
+    virtual bool seek(uint64_t offset) override {
+      f->clear();
+      data.clear();
+      return bool(f->seekg(offset));
+    }
 
    private:
     unique_ptr<ifstream> f;
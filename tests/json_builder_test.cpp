@@ -21,6 +21,7 @@ int main(void) {
   json.key("ahoj").value("nazdar").value(" appended", true);
   json.key("array").array().value("h1").value("h2").value("\"quot\"").value(0).value(-42).value_bool(true).value_bool(false).value(nullptr).close();
   json.key("object").object().key("a").value("A").key("b").value("B").close();
+  json.key_raw("\\\"raw\\\"").value_raw("{\"cached\":[1,2]}");
   json.finish();
 
   cout << json.current();
@@ -30,9 +31,23 @@ int main(void) {
   json.indent().key("ahoj").indent().value("nazdar").value(" appended", true);
   json.indent().key("array").indent().array().indent().value("h1").indent().value("h2").indent().value("\"quot\"").indent().close();
   json.indent().key("object").indent().object().indent().key("a").value("A").indent().key("b").value("B").indent().close();
+  json.indent().key_raw("raw").indent().array().indent().value_raw("{\"cached\":[1,2]}").indent().value_raw("null").indent().close();
   json.finish(true);
 
   cout << json.current();
 
+  json_fragment_cache cache;
+  auto fragment = cache.get("model", [](json_builder& json) { json.object().key("name").value("czech").key("tags").array().value("NOUN"); });
+  json.clear().array().value_raw(*fragment).value_raw(*cache.get("model", [](json_builder&) {})).finish();
+
+  cout << json.current();
+
+  json.clear().array();
+  for (double number : {0.0, -1.5, 0.1, 0.1 + 0.2, 1e23, 1.0 / 3, 123456789012345678.0, 2.2250738585072014e-308, 5e-324, 1.5e-320})
+    json.value(number);
+  json.value(3.14159, 3).finish();
+
+  cout << json.current();
+
   return 0;
 }
@@ -0,0 +1,303 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int socket_t;
+#define close_socket close
+#define INVALID_SOCKET (-1)
+#endif
+
+#include "microrestd.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+// Reference services
+class benchmark_service : public rest_service {
+  class json_generator : public json_response_generator {
+   public:
+    json_generator(unsigned items) : items(items) {
+      json.array();
+    }
+
+    virtual bool generate() override {
+      if (!items) return false;
+      for (unsigned batch = 0; batch < 64 && items; batch++, items--)
+        json.object().key("id").value(int(items)).key("form").value("P\xc5\x99\xc3\xadli\xc5\xa1 \xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88")
+            .key("tags").array().value("NOUN").value("Sing").value_bool(items & 1).close().close();
+      if (!items) json.finish();
+      return true;
+    }
+
+   private:
+    unsigned items;
+  };
+
+  class stream_generator : public response_generator {
+   public:
+    stream_generator(unsigned chunks, unsigned chunk_size) : chunks(chunks), chunk_size(chunk_size) {}
+
+    virtual bool generate() override {
+      if (!chunks) return false;
+      chunks--;
+      data.insert(data.end(), chunk_size, 'x');
+      return true;
+    }
+    virtual string_piece current() const override {
+      return string_piece(data.data(), data.size());
+    }
+    virtual void consume(size_t length) override {
+      if (length >= data.size()) data.clear();
+      else if (length) data.erase(data.begin(), data.begin() + length);
+    }
+
+   private:
+    unsigned chunks, chunk_size;
+    vector<char> data;
+  };
+
+ public:
+  virtual bool handle(rest_request& req) override {
+    if (req.url == "/tiny") return req.respond("text/plain", "OK\n");
+    if (req.url == "/form" || req.url == "/upload") {
+      if (req.method != "POST") return req.respond_method_not_allowed("POST");
+      size_t size = 0;
+      for (auto&& param : req.params) size += param.second.size();
+      return req.respond("text/plain", to_string(size));
+    }
+    if (req.url == "/json") return req.respond(json_response_generator::mime, new json_generator(2000));
+    if (req.url == "/stream") return req.respond("application/octet-stream", new stream_generator(64, 4096));
+    return req.respond_not_found();
+  }
+};
+
+// HTTP client performing requests on a persistent connection
+class http_client {
+ public:
+  ~http_client() { disconnect(); }
+
+  bool connect(unsigned port) {
+    disconnect();
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == INVALID_SOCKET) return false;
+
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (const char*) &nodelay, sizeof(nodelay));
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(fd, (const sockaddr*) &addr, sizeof(addr)) != 0) return disconnect(), false;
+    buffer.clear();
+    return true;
+  }
+
+  void disconnect() {
+    if (fd != INVALID_SOCKET) close_socket(fd);
+    fd = INVALID_SOCKET;
+  }
+
+  // Send the request and read the whole response, returning its status or 0 on failure.
+  unsigned request(const string& request, size_t& response_length) {
+    for (size_t sent = 0; sent < request.size(); ) {
+      auto written = send(fd, request.data() + sent, int(request.size() - sent), 0);
+      if (written <= 0) return 0;
+      sent += written;
+    }
+
+    // Read the headers
+    size_t headers_end;
+    while ((headers_end = buffer.find("\r\n\r\n")) == string::npos)
+      if (!receive()) return 0;
+    unsigned status = strtoul(buffer.c_str() + 9/*HTTP/1.1 */, nullptr, 10);
+    string headers = buffer.substr(0, headers_end + 2);
+    buffer.erase(0, headers_end + 4);
+    for (auto&& chr : headers) chr = tolower(chr);
+
+    // Read the body, either with a known length or chunked
+    response_length = 0;
+    auto content_length = headers.find("\r\ncontent-length:");
+    if (content_length != string::npos) {
+      response_length = strtoull(headers.c_str() + content_length + 17, nullptr, 10);
+      while (buffer.size() < response_length)
+        if (!receive()) return 0;
+      buffer.erase(0, response_length);
+    } else if (headers.find("\r\ntransfer-encoding: chunked") != string::npos) {
+      for (size_t chunk_length = 1; chunk_length; ) {
+        size_t line_end;
+        while ((line_end = buffer.find("\r\n")) == string::npos)
+          if (!receive()) return 0;
+        chunk_length = strtoull(buffer.c_str(), nullptr, 16);
+        while (buffer.size() < line_end + 2 + chunk_length + 2)
+          if (!receive()) return 0;
+        buffer.erase(0, line_end + 2 + chunk_length + 2);
+        response_length += chunk_length;
+      }
+    } else {
+      return 0;
+    }
+
+    return status;
+  }
+
+ private:
+  bool receive() {
+    char data[65536];
+    auto read = recv(fd, data, sizeof(data), 0);
+    if (read <= 0) return false;
+    buffer.append(data, read);
+    return true;
+  }
+
+  socket_t fd = INVALID_SOCKET;
+  string buffer;
+};
+
+// Benchmark scenarios
+struct scenario {
+  const char* name;
+  string request;
+};
+
+static vector<scenario> create_scenarios() {
+  vector<scenario> scenarios;
+
+  scenarios.push_back({"tiny", "GET /tiny HTTP/1.1\r\nHost: localhost\r\n\r\n"});
+
+  string form;
+  for (int i = 0; i < 50; i++)
+    form.append(i ? "&" : "").append("field").append(to_string(i)).append("=value%20").append(to_string(i));
+  scenarios.push_back({"form", "POST /form HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/x-www-form-urlencoded\r\n"
+                               "Content-Length: " + to_string(form.size()) + "\r\n\r\n" + form});
+
+  string multipart = "--benchmarkboundary\r\nContent-Disposition: form-data; name=\"text\"\r\n\r\nshort field\r\n"
+                     "--benchmarkboundary\r\nContent-Disposition: form-data; name=\"data\"; filename=\"data.txt\"\r\n"
+                     "Content-Type: text/plain\r\n\r\n";
+  for (int i = 0; i < 4096; i++)
+    multipart.append("P\xc5\x99\xc3\xadli\xc5\xa1 \xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88 \xc3\xbap\xc4\x9bl \xc4\x8f\xc3\xa1" "belsk\xc3\xa9 \xc3\xb3" "dy, line ").append(to_string(i)).append("\n");
+  multipart.append("\r\n--benchmarkboundary--\r\n");
+  scenarios.push_back({"multipart", "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Type: multipart/form-data; boundary=benchmarkboundary\r\n"
+                                    "Content-Length: " + to_string(multipart.size()) + "\r\n\r\n" + multipart});
+
+  scenarios.push_back({"json", "GET /json HTTP/1.1\r\nHost: localhost\r\n\r\n"});
+  scenarios.push_back({"stream", "GET /stream HTTP/1.1\r\nHost: localhost\r\n\r\n"});
+
+  return scenarios;
+}
+
+// Run the scenario using the given number of connections, each performing the given number of requests.
+static bool run_scenario(const scenario& scenario, unsigned port, unsigned connections, unsigned requests, bool print) {
+  vector<vector<double>> latencies(connections);
+  vector<size_t> response_bytes(connections);
+  vector<bool> failed(connections);
+  vector<thread> clients;
+
+  auto started = chrono::steady_clock::now();
+  for (unsigned i = 0; i < connections; i++)
+    clients.emplace_back([&, i] {
+      http_client client;
+      if (!client.connect(port)) return (void) (failed[i] = true);
+      latencies[i].reserve(requests);
+      for (unsigned r = 0; r < requests; r++) {
+        size_t length;
+        auto request_started = chrono::steady_clock::now();
+        if (client.request(scenario.request, length) != 200) return (void) (failed[i] = true);
+        latencies[i].push_back(chrono::duration<double, milli>(chrono::steady_clock::now() - request_started).count());
+        response_bytes[i] += length;
+      }
+    });
+  for (auto&& client : clients)
+    client.join();
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+  if (find(failed.begin(), failed.end(), true) != failed.end())
+    return cerr << "Scenario " << scenario.name << " failed!" << endl, false;
+  if (!print) return true;
+
+  vector<double> all;
+  size_t bytes = 0;
+  for (unsigned i = 0; i < connections; i++) {
+    all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+    bytes += response_bytes[i];
+  }
+  sort(all.begin(), all.end());
+  auto percentile = [&all](double p) { return all[min(all.size() - 1, size_t(all.size() * p))]; };
+
+  printf("%-10s %9zu %11.1f %10.2f %9.3f %9.3f %9.3f\n", scenario.name, all.size(), all.size() / elapsed,
+         bytes / elapsed / (1 << 20), percentile(0.5), percentile(0.99), percentile(0.999));
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc < 2)
+    return cerr << "Usage: " << argv[0] << " port [scenario|all] [connections] [requests_per_connection] [threads] [min_generated]" << endl, 1;
+  unsigned port = stoi(argv[1]);
+  string selected = argc >= 3 ? argv[2] : "all";
+  unsigned connections = argc >= 4 ? stoi(argv[3]) : 16;
+  unsigned requests = argc >= 5 ? stoi(argv[4]) : 1000;
+  unsigned threads = argc >= 6 ? stoi(argv[5]) : thread::hardware_concurrency();
+  unsigned min_generated = argc >= 7 ? stoi(argv[6]) : 1 << 10;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    return cerr << "Cannot initialize Winsock!" << endl, 1;
+#endif
+
+  struct mode { const char* name; unsigned threads; bool use_poll; };
+  mode modes[] = {{"thread-per-connection", 0, true}, {"pool+poll", threads, true}, {"pool+select", threads, false}};
+
+  auto scenarios = create_scenarios();
+  benchmark_service service;
+  for (auto&& mode : modes) {
+    rest_server server;
+    server.set_keep_alive(true);
+    server.set_min_generated(min_generated);
+    server.set_threads(mode.threads);
+    server.set_use_poll(mode.use_poll);
+    if (!server.start(&service, port))
+      return cerr << "Cannot start REST server!" << endl, 1;
+
+    printf("Mode %s, %u connections, %u requests per connection%s\n", mode.name, connections, requests,
+           mode.threads ? (", " + to_string(mode.threads) + " threads").c_str() : "");
+    printf("%-10s %9s %11s %10s %9s %9s %9s\n", "scenario", "requests", "requests/s", "resp MB/s", "p50 ms", "p99 ms", "p999 ms");
+    for (auto&& scenario : scenarios)
+      if (selected == "all" || selected == scenario.name)
+        if (!run_scenario(scenario, port, connections, max(1U, requests / 10), false) ||
+            !run_scenario(scenario, port, connections, requests, true))
+          return 1;
+    printf("\n");
+
+    server.stop();
+  }
+
+  return 0;
+}
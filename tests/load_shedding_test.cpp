@@ -0,0 +1,121 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int socket_t;
+#define close_socket close
+#define INVALID_SOCKET (-1)
+#endif
+
+#include "microrestd.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+class slow_service : public rest_service {
+ public:
+  virtual bool handle(rest_request& req) override {
+    this_thread::sleep_for(chrono::milliseconds(20));
+    return req.respond("text/plain", "ok\n");
+  }
+};
+
+// Send the request (its body after the given delay) and return the response status.
+unsigned request(unsigned port, const string& head, const string& body = string(), unsigned body_delay = 0) {
+  socket_t fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == INVALID_SOCKET) return 0;
+
+  sockaddr_in address;
+  memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, (sockaddr*) &address, sizeof(address)) != 0) return close_socket(fd), 0;
+
+  send(fd, head.data(), int(head.size()), 0);
+  if (!body.empty()) {
+    this_thread::sleep_for(chrono::milliseconds(body_delay));
+    send(fd, body.data(), int(body.size()), 0);
+  }
+
+  string response;
+  char buffer[1024];
+  for (int read; (read = recv(fd, buffer, sizeof(buffer), 0)) > 0; )
+    response.append(buffer, read);
+  close_socket(fd);
+
+  return response.compare(0, 9, "HTTP/1.1 ") == 0 ? stoi(response.substr(9, 3)) : 0;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned port = argc >= 2 ? stoi(argv[1]) : 18581;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    return cerr << "Cannot initialize Winsock!" << endl, 1;
+#endif
+
+  rest_server server;
+  server.set_threads(1);
+  server.set_load_shedding(5, 50);
+
+  slow_service service;
+  if (!server.start(&service, port))
+    return cerr << "Cannot start REST server!" << endl, 1;
+
+  bool ok = true;
+  auto report = [&](const char* check, bool result) {
+    cout << check << ": " << (result ? "yes" : "no") << endl;
+    ok &= result;
+  };
+
+  // A slowly uploaded request on an idle server is not shed.
+  unsigned status = request(port, "POST /upload HTTP/1.1\r\nHost: localhost\r\nContent-Type: text/plain\r\n"
+                                  "Content-Length: 4\r\nConnection: close\r\n\r\n", "body", 300);
+  report("slow upload on an idle server served", status == 200);
+
+  // Many concurrent clients overload the single thread, so some requests are shed.
+  atomic<unsigned> served(0), shed(0), other(0);
+  auto deadline = chrono::steady_clock::now() + chrono::milliseconds(1500);
+  vector<thread> clients;
+  for (int i = 0; i < 30; i++)
+    clients.emplace_back([&] {
+      while (chrono::steady_clock::now() < deadline) {
+        unsigned status = request(port, "GET /slow HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n");
+        (status == 200 ? served : status == 503 ? shed : other)++;
+      }
+    });
+  for (auto&& client : clients)
+    client.join();
+  report("overloaded server served some requests", served > 0);
+  report("overloaded server shed some requests", shed > 0);
+  report("no other responses", other == 0);
+
+  server.stop();
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,192 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "microrestd.h"
+#include "libmicrohttpd/internal.h"
+#include "rest_server/http_helpers.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+using namespace ufal::microrestd::libmicrohttpd;
+
+// Corpora
+static const char czech_sentence[] = "P\xc5\x99\xc3\xadli\xc5\xa1 \xc5\xbelu\xc5\xa5ou\xc4\x8dk\xc3\xbd k\xc5\xaf\xc5\x88 \xc3\xbap\xc4\x9bl "
+    "\xc4\x8f\xc3\xa1" "belsk\xc3\xa9 \xc3\xb3" "dy, \"\xc5\x99" "ekl\" u\xc4\x8ditel <b>\xc4\x8d" "esk\xc3\xa9ho</b> jazyka & literatury.\n";
+
+static string czech_text(size_t size) {
+  string text;
+  while (text.size() < size) text.append(czech_sentence);
+  return text;
+}
+
+static string url_encode(const string& text) {
+  string encoded;
+  for (auto&& chr : text)
+    if (isalnum((unsigned char) chr)) {
+      encoded.push_back(chr);
+    } else {
+      char escaped[4];
+      snprintf(escaped, sizeof(escaped), "%%%02X", (unsigned char) chr);
+      encoded.append(escaped);
+    }
+  return encoded;
+}
+
+static string form_fields(unsigned fields) {
+  string form;
+  for (unsigned i = 0; i < fields; i++)
+    form.append(i ? "&" : "").append("field").append(to_string(i)).append("=").append(url_encode(czech_text(i % 16)));
+  return form;
+}
+
+static string multipart_body(const string& boundary, const string& file) {
+  string multipart;
+  for (int i = 0; i < 8; i++)
+    multipart.append("--").append(boundary).append("\r\nContent-Disposition: form-data; name=\"field").append(to_string(i))
+        .append("\"\r\n\r\nvalue ").append(to_string(i)).append("\r\n");
+  multipart.append("--").append(boundary).append("\r\nContent-Disposition: form-data; name=\"data\"; filename=\"data.txt\"\r\n"
+                                                 "Content-Type: text/plain\r\n\r\n").append(file).append("\r\n");
+  multipart.append("--").append(boundary).append("--\r\n");
+  return multipart;
+}
+
+// Run the benchmark repeatedly for at least the given time, and report the time per processed byte.
+static double min_time = 0.5;
+static void benchmark(const char* name, size_t bytes, const function<void()>& body) {
+  body();
+
+  size_t iterations = 0;
+  double elapsed = 0;
+  auto started = chrono::steady_clock::now();
+  for (size_t batch = 1; elapsed < min_time; batch = iterations) {
+    for (size_t i = 0; i < batch; i++) body();
+    iterations += batch;
+    elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+  }
+
+  printf("%-40s %12zu %9.3f %9.1f\n", name, bytes, elapsed * 1e9 / (double(iterations) * bytes), double(iterations) * bytes / elapsed / (1 << 20));
+}
+
+// Keep the results of the benchmarks observable.
+static size_t sink;
+
+int main(int argc, char* argv[]) {
+  if (argc > 2)
+    return cerr << "Usage: " << argv[0] << " [min_seconds_per_benchmark]" << endl, 1;
+  if (argc > 1) min_time = atof(argv[1]);
+
+  string text = czech_text(1 << 20);
+  vector<string> small_values;
+  size_t small_values_bytes = 0;
+  for (unsigned i = 0; i < 10000; i++)
+    small_values.push_back(czech_text(i % 32)), small_values_bytes += small_values.back().size();
+
+  printf("%-40s %12s %9s %9s\n", "benchmark", "bytes", "ns/byte", "MB/s");
+
+  // json_builder
+  json_builder json;
+  benchmark("json_builder::value czech", text.size(), [&] {
+    json.clear().array().value(text).finish();
+    sink += json.current().len;
+  });
+  benchmark("json_builder::value small fields", small_values_bytes, [&] {
+    json.clear().object();
+    for (auto&& value : small_values) json.key("field").value(value);
+    json.finish();
+    sink += json.current().len;
+  });
+  benchmark("json_builder::value_xml_escape czech", text.size(), [&] {
+    json.clear().array().value_xml_escape(text).finish();
+    sink += json.current().len;
+  });
+  benchmark("json_builder::indent small fields", small_values_bytes, [&] {
+    json.clear().object();
+    for (auto&& value : small_values) json.indent().key("field").indent().array().indent().value(value).close();
+    json.finish(true);
+    sink += json.current().len;
+  });
+
+  // xml_builder
+  xml_builder xml;
+  benchmark("xml_builder::text czech", text.size(), [&] {
+    xml.clear().element("text").text(text).finish();
+    sink += xml.current().len;
+  });
+  benchmark("xml_builder::attribute small fields", small_values_bytes, [&] {
+    xml.clear().element("fields");
+    for (auto&& value : small_values) xml.element("field").attribute("value", value).close();
+    xml.finish();
+    sink += xml.current().len;
+  });
+
+  // http_helpers
+  benchmark("http_helpers::valid_utf8 czech", text.size(), [&] {
+    sink += http_helpers::valid_utf8(text);
+  });
+  const char* content_types[] = {"application/x-www-form-urlencoded", " Multipart/Form-Data ; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW",
+                                 "text/plain; charset=utf-8", "application/json"};
+  size_t content_types_bytes = 0;
+  for (auto&& content_type : content_types) content_types_bytes += strlen(content_type);
+  benchmark("http_helpers::http_value_compare", content_types_bytes, [&] {
+    for (auto&& content_type : content_types)
+      sink += http_helpers::http_value_compare(content_type, MHD_HTTP_POST_ENCODING_FORM_URLENCODED) +
+              http_helpers::http_value_compare(content_type, MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA);
+  });
+
+  // libmicrohttpd
+  string encoded = url_encode(text), unescaped;
+  benchmark("MHD_http_unescape czech", encoded.size(), [&] {
+    unescaped = encoded;
+    sink += MHD_http_unescape(&unescaped[0]);
+  });
+
+  // The post processor only looks up the Content-Type of the connection.
+  auto post_process = [](const char* content_type, const string& body) {
+    MHD_Connection connection;
+    memset(&connection, 0, sizeof(connection));
+    MHD_HTTP_Header header;
+    memset(&header, 0, sizeof(header));
+    header.header = (char*) MHD_HTTP_HEADER_CONTENT_TYPE;
+    header.value = (char*) content_type;
+    header.kind = MHD_HEADER_KIND;
+    connection.headers_received = &header;
+
+    struct iterator {
+      static int count(void* cls, MHD_ValueKind /*kind*/, const char* /*key*/, const char* /*filename*/, const char* /*content_type*/,
+                       const char* /*transfer_encoding*/, const char* /*data*/, uint64_t /*off*/, size_t size) {
+        *(size_t*) cls += size;
+        return MHD_YES;
+      }
+    };
+    size_t processed = 0;
+    auto post_processor = MHD_create_post_processor(&connection, 32 << 10, &iterator::count, &processed);
+    if (!post_processor) return cerr << "Cannot create post processor!" << endl, exit(1);
+    MHD_post_process(post_processor, body.data(), body.size());
+    MHD_destroy_post_processor(post_processor);
+    sink += processed;
+  };
+  string form = form_fields(10000);
+  benchmark("MHD_post_process urlencoded small fields", form.size(), [&] {
+    post_process(MHD_HTTP_POST_ENCODING_FORM_URLENCODED, form);
+  });
+  string multipart = multipart_body("----WebKitFormBoundary7MA4YWxkTrZu0gW", czech_text(4 << 20));
+  benchmark("MHD_post_process multipart large file", multipart.size(), [&] {
+    post_process(MHD_HTTP_POST_ENCODING_MULTIPART_FORMDATA "; boundary=----WebKitFormBoundary7MA4YWxkTrZu0gW", multipart);
+  });
+
+  return sink ? 0 : 1;
+}
@@ -0,0 +1,52 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include "rest_server/rate_limiter.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+int main(void) {
+  bool ok = true;
+  auto report = [&](const char* check, bool result) {
+    cout << check << ": " << (result ? "yes" : "no") << endl;
+    ok &= result;
+  };
+
+  rate_limiter limiter;
+  report("disabled limiter allows everything", !limiter.enabled() && limiter.allow("a") && limiter.allow("a") && limiter.clients() == 0);
+
+  // Token refill: 10 requests per second with a burst of 2
+  limiter.set_limit(10, 2);
+  report("burst allowed", limiter.allow("a") && limiter.allow("a"));
+  report("over the burst denied", !limiter.allow("a"));
+  report("other client allowed", limiter.allow("b"));
+  this_thread::sleep_for(chrono::milliseconds(150));
+  report("one token refilled", limiter.allow("a") && !limiter.allow("a"));
+  this_thread::sleep_for(chrono::milliseconds(300));
+  report("refill capped by the burst", limiter.allow("a") && limiter.allow("a") && !limiter.allow("a"));
+
+  // Purge: with a very fast refill, the buckets are full again almost
+  // immediately, so they are dropped once a shard grows large enough.
+  limiter.set_limit(1e6, 1);
+  report("set_limit clears the buckets", limiter.clients() == 0);
+  for (int i = 0; i < 20000; i++) limiter.allow("first " + to_string(i));
+  this_thread::sleep_for(chrono::milliseconds(10));
+  for (int i = 0; i < 20000; i++) limiter.allow("second " + to_string(i));
+  cout << "clients stored after 40000 distinct clients: " << limiter.clients() << endl;
+  report("full buckets purged", limiter.clients() <= 16 * 1024);
+  report("purged client allowed", limiter.allow("first 0"));
+
+  return ok ? 0 : 1;
+}
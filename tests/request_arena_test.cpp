@@ -0,0 +1,77 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "microrestd.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+// Sizes of the consecutive memory blocks the arena serves one-byte allocations from.
+vector<size_t> block_sizes(request_arena& arena, unsigned blocks) {
+  vector<size_t> sizes(1, 1);
+  for (char* previous = (char*) arena.allocate(1, 1); sizes.size() <= blocks; ) {
+    char* next = (char*) arena.allocate(1, 1);
+    if (next == previous + 1) sizes.back()++;
+    else sizes.push_back(1);
+    previous = next;
+  }
+  sizes.pop_back();
+  return sizes;
+}
+
+int main(void) {
+  bool ok = true;
+  auto report = [&](const char* check, bool result) {
+    cout << check << ": " << (result ? "yes" : "no") << endl;
+    ok &= result;
+  };
+
+  request_arena arena;
+  auto inside = [&arena](void* ptr) { return (char*) ptr >= (char*) &arena && (char*) ptr < (char*) (&arena + 1); };
+
+  // Alignment
+  char* first = (char*) arena.allocate(1, 1);
+  bool aligned = true;
+  for (size_t alignment : {2, 4, 8, 16, 32, 64}) {
+    arena.allocate(1, 1);
+    aligned &= uintptr_t(arena.allocate(3, alignment)) % alignment == 0;
+  }
+  aligned &= uintptr_t(arena.allocate(1)) % alignof(max_align_t) == 0;
+  report("allocations are aligned", aligned);
+
+  char* second = (char*) arena.allocate(10, 1);
+  report("allocations are consecutive", (char*) arena.allocate(10, 1) == second + 10);
+  report("first allocations use the initial buffer", inside(first) && inside(second));
+
+  // Chunk growth
+  auto sizes = block_sizes(arena, 4);
+  bool doubling = true;
+  for (size_t i = 2; i < sizes.size(); i++)
+    doubling &= sizes[i] >= 2 * sizes[i - 1] && sizes[i] <= 2 * sizes[i - 1] + 64;
+  report("chunks grow twice as large", doubling);
+
+  char* large = (char*) arena.allocate(1 << 20, 64);
+  memset(large, 0, 1 << 20);
+  report("large allocation gets its own chunk", !inside(large) && uintptr_t(large) % 64 == 0);
+
+  // Clearing
+  arena.clear();
+  report("cleared arena uses the initial buffer again", arena.allocate(1, 1) == first);
+
+  vector<int, arena_allocator<int>> numbers{arena_allocator<int>(arena)};
+  for (int i = 0; i < 10000; i++) numbers.push_back(i);
+  report("arena_allocator keeps values", numbers[0] == 0 && numbers[9999] == 9999);
+
+  return ok ? 0 : 1;
+}
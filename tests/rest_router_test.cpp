@@ -0,0 +1,128 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <iostream>
+#include <string>
+
+#include "microrestd.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+// Request printing how it was responded to.
+class printing_request : public rest_request {
+ public:
+  printing_request(const char* method, const char* url) {
+    this->method = method;
+    this->url = url;
+    cout << method << ' ' << url << " -> ";
+  }
+
+  virtual bool respond(const char* /*content_type*/, string_piece body,
+                       const vector<pair<const char*, const char*>>& /*headers*/ = {}) override {
+    cout << string(body.str, body.len) << endl;
+    return true;
+  }
+  virtual bool respond(const char* /*content_type*/, response_generator* generator,
+                       const vector<pair<const char*, const char*>>& /*headers*/ = {}) override {
+    delete generator;
+    cout << "generator" << endl;
+    return true;
+  }
+  virtual bool respond_not_found() override {
+    cout << "404 Not Found" << endl;
+    return true;
+  }
+  virtual bool respond_method_not_allowed(const char* comma_separated_allowed_methods) override {
+    cout << "405 Method Not Allowed, Allow: " << comma_separated_allowed_methods << endl;
+    return true;
+  }
+  virtual bool respond_error(string_piece error, int code = 400) override {
+    cout << code << ' ' << string(error.str, error.len) << endl;
+    return true;
+  }
+};
+
+// Handler responding with the route and its captures.
+rest_router::handler responder(const char* route) {
+  return [route](rest_request& req, const rest_router::captures& captures) {
+    string response = route;
+    for (unsigned i = 0; i < captures.size(); i++)
+      response.append(i ? ", " : " with ").append(captures[i].str, captures[i].len);
+    return req.respond("text/plain", response);
+  };
+}
+
+int main(void) {
+  rest_router router;
+  request_limits process_limits;
+
+  cout << "Adding routes: "
+       << router.add_route(rest_router::METHOD_GET, "/models", responder("GET /models"))
+       << router.add_route(rest_router::METHOD_GET, "/models/{name}", responder("GET /models/{name}"))
+       << router.add_route(rest_router::METHOD_DELETE, "/models/{name}", responder("DELETE /models/{name}"))
+       << router.add_route(rest_router::METHOD_POST, "/models/{name}/process", responder("POST /models/{name}/process"), &process_limits)
+       << router.add_route(rest_router::METHOD_PUT, "/models/{name}/weights/{version}", responder("PUT /models/{name}/weights/{version}"))
+       << router.add_route(rest_router::METHOD_GET, "/models/list", responder("GET /models/list"))
+       << router.add_route(rest_router::METHOD_HEAD, "/models/list", responder("HEAD /models/list"))
+       << router.add_route(rest_router::METHOD_GET, "/{collection}/info", responder("GET /{collection}/info"))
+       << router.add_route(rest_router::METHOD_GET, "/{a}/{b}/{c}/{d}", responder("GET /{a}/{b}/{c}/{d}"))
+       << router.add_route(rest_router::METHOD_GET, "/a/{x}/c", responder("GET /a/{x}/c"))
+       << router.add_route(rest_router::METHOD_GET, "/a/b/d", responder("GET /a/b/d"))
+       << endl;
+
+  cout << "Adding invalid routes: "
+       << router.add_route(rest_router::METHOD_GET, "/models", responder("duplicate"))
+       << router.add_route(rest_router::METHOD_GET, "models", responder("relative"))
+       << router.add_route(rest_router::METHOD_GET, "/models/{name", responder("unclosed"))
+       << router.add_route(rest_router::METHOD_GET, "/models/{}", responder("empty"))
+       << router.add_route(rest_router::METHOD_GET, "/models/x{name}", responder("partial segment"))
+       << endl;
+
+  const char* requests[][2] = {
+    // Captures
+    {"GET", "/models"},
+    {"GET", "/models/czech"},
+    {"POST", "/models/czech/process"},
+    {"PUT", "/models/czech/weights/3"},
+    {"GET", "/models/czech/unknown"},
+    {"GET", "/unknown"},
+    {"GET", "/"},
+    // Method not allowed
+    {"POST", "/models/czech"},
+    {"GET", "/models/czech/process"},
+    {"PATCH", "/models"},
+    {"BREW", "/models"},
+    // HEAD answered by GET, unless there is a HEAD handler
+    {"HEAD", "/models/czech"},
+    {"HEAD", "/models/list"},
+    // Static segments take precedence over parameters
+    {"GET", "/models/list"},
+    {"GET", "/models/lis"},
+    {"GET", "/models/lists"},
+    {"DELETE", "/models/list"},
+    {"GET", "/models/info"},
+    {"GET", "/data/info"},
+    {"GET", "/models/a/b/c"},
+    {"GET", "/w/x/y/z"},
+    // Backtracking from a static segment to a parameter
+    {"GET", "/a/b/c"},
+    {"GET", "/a/b/d"},
+    {"GET", "/a/e/c"},
+  };
+  for (auto&& request : requests) {
+    printing_request req(request[0], request[1]);
+    router.handle(req);
+  }
+
+  printing_request process("POST", "/models/czech/process");
+  cout << "limits " << (router.limits(process) == &process_limits ? "found" : "not found") << endl;
+
+  return 0;
+}
@@ -0,0 +1,74 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+#include "rest_server/server_metrics.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+// Return the value of the metric line with the given name and labels.
+string metric(const string& metrics, const string& name) {
+  size_t start = metrics.find("\n" + name + " ");
+  if (start == string::npos) return "missing";
+  start += name.size() + 2;
+  return metrics.substr(start, metrics.find('\n', start) - start);
+}
+
+int main(void) {
+  bool ok = true;
+  auto report = [&](const string& name, const string& metrics, const char* expected) {
+    string value = metric(metrics, name);
+    cout << name << " " << value << endl;
+    ok &= value == expected;
+  };
+
+  server_metrics metrics;
+
+  // The latencies at and right after the histogram bounds, which are inclusive.
+  uint64_t latencies[] = {0, 1, 15, 16, 17, 32, 33, 1 << 20, (1 << 20) + 1, uint64_t(1) << 32, (uint64_t(1) << 32) + 1};
+  unsigned statuses[] = {200, 200, 204, 301, 404, 404, 500, 503, 99, 200, 200};
+  for (unsigned i = 0; i < sizeof(latencies) / sizeof(*latencies); i++) {
+    metrics.request_started();
+    metrics.request_completed(statuses[i], statuses[i] == 500, 10, 100, latencies[i]);
+  }
+  metrics.request_started();
+  metrics.request_queued(1);
+
+  string output;
+  metrics.export_prometheus(output, 3, 7);
+
+  report("microrestd_requests_total{code=\"1xx\"}", output, "0");
+  report("microrestd_requests_total{code=\"2xx\"}", output, "5");
+  report("microrestd_requests_total{code=\"3xx\"}", output, "1");
+  report("microrestd_requests_total{code=\"4xx\"}", output, "2");
+  report("microrestd_requests_total{code=\"5xx\"}", output, "2");
+  report("microrestd_requests_failed_total", output, "1");
+  report("microrestd_received_bytes_total", output, "110");
+  report("microrestd_sent_bytes_total", output, "1100");
+  report("microrestd_requests_in_flight", output, "1");
+  report("microrestd_requests_queued", output, "1");
+  report("microrestd_connections", output, "3");
+  report("microrestd_log_dropped_lines_total", output, "7");
+
+  report("microrestd_request_duration_seconds_bucket{le=\"1.6e-05\"}", output, "4");
+  report("microrestd_request_duration_seconds_bucket{le=\"3.2e-05\"}", output, "6");
+  report("microrestd_request_duration_seconds_bucket{le=\"6.4e-05\"}", output, "7");
+  report("microrestd_request_duration_seconds_bucket{le=\"0.524288\"}", output, "7");
+  report("microrestd_request_duration_seconds_bucket{le=\"1.048576\"}", output, "8");
+  report("microrestd_request_duration_seconds_bucket{le=\"2.097152\"}", output, "9");
+  report("microrestd_request_duration_seconds_bucket{le=\"4294.9673\"}", output, "10");
+  report("microrestd_request_duration_seconds_bucket{le=\"+Inf\"}", output, "11");
+  report("microrestd_request_duration_seconds_count", output, "11");
+
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,157 @@
+// This file is part of MicroRestD <http://github.com/ufal/microrestd/>.
+//
+// Copyright 2015 Institute of Formal and Applied Linguistics, Faculty of
+// Mathematics and Physics, Charles University in Prague, Czech Republic.
+//
+// This Source Code Form is subject to the terms of the Mozilla Public
+// License, v. 2.0. If a copy of the MPL was not distributed with this
+// file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int socket_t;
+#define close_socket close
+#endif
+
+#include "microrestd.h"
+
+using namespace std;
+using namespace ufal::microrestd;
+
+class sse_service : public rest_service {
+ public:
+  virtual bool handle(rest_request& req) override {
+    if (req.url == "/events") {
+      auto generator = new sse_response_generator(1);
+      {
+        lock_guard<mutex> lock(streams_mutex);
+        streams.push_back(generator->events());
+      }
+      return req.respond(sse_response_generator::mime, generator);
+    }
+    return req.respond("text/plain", "tiny\n");
+  }
+
+  shared_ptr<sse_response_generator::stream> stream(size_t index) {
+    lock_guard<mutex> lock(streams_mutex);
+    return index < streams.size() ? streams[index] : nullptr;
+  }
+
+ private:
+  mutex streams_mutex;
+  vector<shared_ptr<sse_response_generator::stream>> streams;
+};
+
+class client {
+ public:
+  client(unsigned port, const char* url) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+#if defined(_WIN32) && !defined(__CYGWIN__)
+    DWORD timeout = 100;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, (const char*) &timeout, sizeof(timeout));
+#else
+    timeval timeout = {0, 100000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#endif
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    string request = string("GET ") + url + " HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+    if (connect(fd, (sockaddr*) &address, sizeof(address)) == 0)
+      send(fd, request.data(), int(request.size()), 0);
+  }
+  ~client() { close_socket(fd); }
+
+  // Wait at most the given number of milliseconds until the response
+  // contains the text, or until it ends if no text is given.
+  bool received(const char* text, unsigned milliseconds) {
+    auto deadline = chrono::steady_clock::now() + chrono::milliseconds(milliseconds);
+    while (!(text ? response.find(text) != string::npos : ended)) {
+      if (ended || chrono::steady_clock::now() >= deadline) return false;
+      char buffer[1024];
+      int read = recv(fd, buffer, sizeof(buffer), 0);
+      if (read > 0) response.append(buffer, read);
+      else if (read == 0) ended = true;
+    }
+    return true;
+  }
+
+ private:
+  socket_t fd;
+  string response;
+  bool ended = false;
+};
+
+bool test(const char* mode, unsigned threads, bool use_poll, unsigned port) {
+  rest_server server;
+  server.set_threads(threads);
+  server.set_use_poll(use_poll);
+
+  sse_service service;
+  if (!server.start(&service, port))
+    return cerr << "Cannot start REST server!" << endl, false;
+
+  bool ok = true;
+  auto report = [&](const char* check, bool result) {
+    cout << mode << ": " << check << ": " << (result ? "yes" : "no") << endl;
+    ok &= result;
+  };
+
+  client events(port, "/events");
+  report("event stream started", events.received("text/event-stream", 1000));
+  {
+    client tiny(port, "/tiny");
+    report("other request answered while the event stream is idle", tiny.received("tiny\n", 500));
+  }
+
+  auto stream = service.stream(0);
+  report("event sent", stream && stream->event("hello", "greeting"));
+  report("event received", events.received("event: greeting\ndata: hello\n\n", 500));
+  report("heartbeat received", events.received(":\n\n", 2000));
+  stream->close();
+  report("event stream closed", events.received(nullptr, 500));
+
+  client idle(port, "/events");
+  report("second event stream started", idle.received("text/event-stream", 1000));
+  auto started = chrono::steady_clock::now();
+  server.stop();
+  report("server stopped with an idle event stream", chrono::steady_clock::now() - started < chrono::seconds(1));
+
+  return ok;
+}
+
+int main(int argc, char* argv[]) {
+  unsigned port = argc >= 2 ? stoi(argv[1]) : 18571;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  WSADATA wsa_data;
+  if (WSAStartup(MAKEWORD(2, 2), &wsa_data) != 0)
+    return cerr << "Cannot initialize Winsock!" << endl, 1;
+#endif
+
+  bool ok = true;
+  ok &= test("thread per connection", 0, true, port);
+  ok &= test("thread pool with poll", 1, true, port + 1);
+  ok &= test("thread pool with select", 1, false, port + 2);
+
+  return ok ? 0 : 1;
+}